@@ -0,0 +1,137 @@
+/*******************************************************************************
+ * Benchmark: batch lookups
+ * Compares hashtable_get() called in a loop with hashtable_get_batch() and
+ * hashtable_set() in a loop with hashtable_set_batch(), on tables much larger
+ * than the CPU caches, with keys requested in random order.
+ * Usage: ./batch [number of keys] [keys per batch]
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../hashtable.h"
+
+
+int string_compare(void *str1, void *str2) {
+    return strcmp((char*)str1, (char*)str2);
+}
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned long xorshift(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    unsigned long n = 2000000;
+    unsigned long batch = 32;
+    unsigned long state = 88172645463325252UL;
+    unsigned long i, j, found;
+    char **keys = NULL;
+    void **lookups = NULL;
+    void **values = NULL;
+    hashtable_t *h = NULL;
+    double start, loop_time, batch_time;
+
+    if (argc > 1)
+        n = strtoul(argv[1], NULL, 10);
+    if (argc > 2)
+        batch = strtoul(argv[2], NULL, 10);
+    if (n < 1 || batch < 1)
+        return -1;
+
+    keys = (char **) malloc (n * sizeof(char*));
+    lookups = (void **) malloc (n * sizeof(void*));
+    values = (void **) malloc (batch * sizeof(void*));
+    if (keys == NULL || lookups == NULL || values == NULL)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        keys[i] = (char *) malloc (24);
+        if (keys[i] == NULL)
+            return -1;
+        sprintf(keys[i], "key-%lu", i);
+    }
+
+    for (i = 0; i < n; i++)
+        lookups[i] = keys[xorshift(&state) % n];
+
+    printf("%lu keys, %lu keys per batch\n\n", n, batch);
+
+    // Warm up the allocator, so both insertion runs reuse the same memory
+    h = hashtable_create(n, string_compare, string_hash_value, NULL, NULL);
+    if (h == NULL)
+        return -1;
+    for (i = 0; i < n; i++)
+        hashtable_set(h, lookups[i], lookups[i]);
+    hashtable_delete(h);
+
+    // Insertion
+    h = hashtable_create(n, string_compare, string_hash_value, NULL, NULL);
+    if (h == NULL)
+        return -1;
+    start = now();
+    for (i = 0; i < n; i++)
+        hashtable_set(h, lookups[i], lookups[i]);
+    loop_time = now() - start;
+    hashtable_delete(h);
+
+    h = hashtable_create(n, string_compare, string_hash_value, NULL, NULL);
+    if (h == NULL)
+        return -1;
+    start = now();
+    for (i = 0; i < n; i += batch)
+        hashtable_set_batch(h, lookups + i, lookups + i,
+                            n - i < batch ? n - i : batch);
+    batch_time = now() - start;
+
+    printf("set loop:  %6.1f ns/key\n", loop_time * 1e9 / n);
+    printf("set batch: %6.1f ns/key (%.2fx)\n\n", batch_time * 1e9 / n,
+           loop_time / batch_time);
+
+    // Lookup
+    for (i = 0; i < n; i++)
+        lookups[i] = keys[xorshift(&state) % n];
+
+    found = 0;
+    start = now();
+    for (i = 0; i < n; i++)
+        if (hashtable_get(h, lookups[i]) != NULL)
+            found++;
+    loop_time = now() - start;
+
+    start = now();
+    for (i = 0; i < n; i += batch) {
+        j = n - i < batch ? n - i : batch;
+        found -= hashtable_get_batch(h, lookups + i, j, values);
+    }
+    batch_time = now() - start;
+
+    if (found != 0) {
+        printf("Error: loop and batch found different keys.\n");
+        return -1;
+    }
+
+    printf("get loop:  %6.1f ns/key\n", loop_time * 1e9 / n);
+    printf("get batch: %6.1f ns/key (%.2fx)\n", batch_time * 1e9 / n,
+           loop_time / batch_time);
+
+    hashtable_delete(h);
+    for (i = 0; i < n; i++)
+        free(keys[i]);
+    free(keys);
+    free(lookups);
+    free(values);
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*******************************************************************************
+ * Benchmark: typed tables
+ * Compares a table of integer keys used through the generic API
+ * (hashtable_set() and hashtable_get() with function pointers, open addressing
+ * backend) with a hashtable_u64_t (keys stored in the table) and with the same
+ * table generated by HASHTABLE_DEFINE(), which inlines hashing and key
+ * comparison. Keys are requested in random order.
+ * Usage: ./typed [number of keys]
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "../hashtable.h"
+#include "../hashtable_typed.h"
+
+HASHTABLE_DEFINE(intmap, unsigned long, unsigned long,
+                 hashtable_typed_hash_int, hashtable_typed_equal_int)
+
+
+int int_compare(void *int1, void *int2) {
+    return int1 != int2;
+}
+
+unsigned long int_hash_value(void *key) {
+    return (unsigned long) (uintptr_t) key;
+}
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned long xorshift(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    unsigned long n = 1000000;
+    unsigned long state = 88172645463325252UL;
+    unsigned long i, sum_generic = 0, sum_u64 = 0, sum_typed = 0;
+    unsigned long *keys = NULL;
+    unsigned long *value = NULL;
+    hashtable_options_t options;
+    hashtable_t *h = NULL;
+    hashtable_u64_t *u = NULL;
+    intmap_t *t = NULL;
+    double start, generic_set, generic_get, u64_set, u64_get;
+    double typed_set, typed_get;
+
+    if (argc > 1)
+        n = strtoul(argv[1], NULL, 10);
+    if (n < 1)
+        return -1;
+
+    keys = (unsigned long *) malloc (n * sizeof(unsigned long));
+    if (keys == NULL)
+        return -1;
+    for (i = 0; i < n; i++)
+        keys[i] = xorshift(&state) % (n * 4) + 1;
+
+    printf("%lu integer keys\n\n", n);
+
+    // Generic API
+    hashtable_options_init(&options);
+    options.backend = HASHTABLE_BACKEND_OPEN_ADDRESSING;
+    h = hashtable_create_with_options(16, int_compare, int_hash_value,
+                                      NULL, NULL, &options);
+    if (h == NULL)
+        return -1;
+
+    start = now();
+    for (i = 0; i < n; i++)
+        hashtable_set(h, (void *) keys[i], (void *) i);
+    generic_set = now() - start;
+
+    start = now();
+    for (i = 0; i < n; i++)
+        sum_generic += (unsigned long) hashtable_get(h, (void *) keys[n - 1 - i]);
+    generic_get = now() - start;
+
+    hashtable_delete(h);
+
+    // Integer key table
+    u = hashtable_u64_create(16, NULL);
+    if (u == NULL)
+        return -1;
+
+    start = now();
+    for (i = 0; i < n; i++)
+        hashtable_u64_set(u, keys[i], (void *) i);
+    u64_set = now() - start;
+
+    start = now();
+    for (i = 0; i < n; i++)
+        sum_u64 += (unsigned long) hashtable_u64_get(u, keys[n - 1 - i]);
+    u64_get = now() - start;
+
+    hashtable_u64_delete(u);
+
+    // Typed table
+    t = intmap_create(16);
+    if (t == NULL)
+        return -1;
+
+    start = now();
+    for (i = 0; i < n; i++)
+        intmap_set(t, keys[i], i);
+    typed_set = now() - start;
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        value = intmap_get(t, keys[n - 1 - i]);
+        if (value != NULL)
+            sum_typed += *value;
+    }
+    typed_get = now() - start;
+
+    intmap_delete(t);
+
+    if (sum_generic != sum_u64 || sum_generic != sum_typed) {
+        printf("Error: tables found different values.\n");
+        return -1;
+    }
+
+    printf("set generic: %6.1f ns/key\n", generic_set * 1e9 / n);
+    printf("set u64:     %6.1f ns/key (%.2fx)\n", u64_set * 1e9 / n,
+           generic_set / u64_set);
+    printf("set typed:   %6.1f ns/key (%.2fx)\n\n", typed_set * 1e9 / n,
+           generic_set / typed_set);
+    printf("get generic: %6.1f ns/key\n", generic_get * 1e9 / n);
+    printf("get u64:     %6.1f ns/key (%.2fx)\n", u64_get * 1e9 / n,
+           generic_get / u64_get);
+    printf("get typed:   %6.1f ns/key (%.2fx)\n", typed_get * 1e9 / n,
+           generic_get / typed_get);
+
+    free(keys);
+
+    return 0;
+}
@@ -0,0 +1,548 @@
+/*******************************************************************************
+ * Benchmark: workloads
+ * Drives hashtable_set(), hashtable_get() and hashtable_delete_key() with
+ * integer and string keys, uniform and Zipfian key distributions and a mix of
+ * hits and misses, on tables from a few KB (L1 cache) to far beyond the last
+ * level cache. For every phase prints operations per second, latency
+ * percentiles (p50, p99 and p999) and the resident memory of the process.
+ *
+ * Phases of every workload:
+ *   insert  new keys in random order, starting from a small table
+ *   get     existing keys, with the key distribution
+ *   mixed   "-m" percent of missing keys, the rest with the key distribution
+ *   update  hashtable_set() of existing keys, with the key distribution
+ *   delete  all keys in random order
+ *
+ * Operations per second are measured without timing each operation. Latency
+ * is measured in a second run, timing every operation and subtracting the
+ * cost of reading the clock, so very fast operations show as a few ns.
+ *
+ * Results can be saved with "-o" and compared with a previous run with "-b"
+ * (change of operations per second and p99 latency), to check an optimization
+ * or catch a regression:
+ *   ./workload -o before.txt
+ *   ./workload -b before.txt
+ *
+ * Usage: ./workload [-k max keys] [-n operations per phase] [-m miss percent]
+ *                   [-a (open addressing)] [-o results file] [-b baseline file]
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "../hashtable.h"
+
+#define MAX_RESULTS 256
+#define ZIPF_THETA  0.99
+
+enum { KEYS_INT, KEYS_STRING };
+enum { DIST_UNIFORM, DIST_ZIPF };
+
+typedef struct result_s {
+    char name[64];
+    double ops;
+    unsigned long p50;
+    unsigned long p99;
+    unsigned long p999;
+    long rss;
+} result_t;
+
+typedef struct workload_s {
+    int key_type;
+    int distribution;
+    unsigned long n;
+    void **keys;
+    void **misses;
+    hashtable_options_t options;
+    fp_compare_keys compare;
+    fp_hashvalue hashvalue;
+} workload_t;
+
+typedef struct zipf_s {
+    unsigned long n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} zipf_t;
+
+unsigned long timer_overhead = 0;
+
+
+int string_compare(void *str1, void *str2) {
+    return strcmp((char*)str1, (char*)str2);
+}
+
+int int_compare(void *int1, void *int2) {
+    return int1 != int2;
+}
+
+unsigned long int_hash_value(void *key) {
+    return (unsigned long) ((uintptr_t) key * 0x9e3779b97f4a7c15UL);
+}
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+unsigned long xorshift(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+double uniform(unsigned long *state) {
+    return (xorshift(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Resident memory of the process in bytes, 0 if unknown.
+ */
+long rss_bytes() {
+    long pages = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+
+    if (file == NULL)
+        return 0;
+    if (fscanf(file, "%*s %ld", &pages) != 1)
+        pages = 0;
+    fclose(file);
+
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Zipfian generator of Gray et al., "Quickly generating billion-record
+ * synthetic databases" (the one used by YCSB). Rank 0 is the most popular.
+ */
+void zipf_init(zipf_t *zipf, unsigned long n, double theta) {
+    unsigned long i;
+    double zeta2 = 1.0 + pow(0.5, theta);
+
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->zetan = 0;
+    for (i = 1; i <= n; i++)
+        zipf->zetan += 1.0 / pow((double) i, theta);
+    zipf->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan);
+}
+
+unsigned long zipf_next(zipf_t *zipf, unsigned long *state) {
+    double u = uniform(state);
+    double uz = u * zipf->zetan;
+    unsigned long rank;
+
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + pow(0.5, zipf->theta))
+        return 1;
+    rank = (unsigned long) (zipf->n * pow(zipf->eta * u - zipf->eta + 1.0,
+                                          zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/*
+ * Fills "sequence" with "count" keys of the workload. "miss_percent" of them
+ * are missing keys, chosen uniformly. Popular ranks are scattered over the
+ * keys, so hot keys are not neighbours in memory.
+ */
+void make_sequence(workload_t *w, zipf_t *zipf, void **sequence,
+                   unsigned long count, int miss_percent,
+                   unsigned long *state) {
+    unsigned long i, rank;
+
+    for (i = 0; i < count; i++) {
+        if (miss_percent > 0 && (int) (xorshift(state) % 100) < miss_percent) {
+            sequence[i] = w->misses[xorshift(state) % w->n];
+            continue;
+        }
+        if (w->distribution == DIST_ZIPF)
+            rank = zipf_next(zipf, state) * 0x9e3779b97f4a7c15UL % w->n;
+        else
+            rank = xorshift(state) % w->n;
+        sequence[i] = w->keys[rank];
+    }
+}
+
+void shuffle(void **array, unsigned long n, unsigned long *state) {
+    unsigned long i, j;
+    void *tmp;
+
+    for (i = n - 1; i > 0; i--) {
+        j = xorshift(state) % (i + 1);
+        tmp = array[i];
+        array[i] = array[j];
+        array[j] = tmp;
+    }
+}
+
+int compare_latency(const void *a, const void *b) {
+    unsigned long x = *(const unsigned long *) a;
+    unsigned long y = *(const unsigned long *) b;
+    return x < y ? -1 : x > y;
+}
+
+void percentiles(result_t *result, unsigned long *latencies,
+                 unsigned long count) {
+    qsort(latencies, count, sizeof(unsigned long), compare_latency);
+    result->p50 = latencies[count / 2];
+    result->p99 = latencies[(unsigned long) (count * 0.99)];
+    result->p999 = latencies[(unsigned long) (count * 0.999)];
+}
+
+unsigned long elapsed(unsigned long start) {
+    unsigned long ns = now_ns() - start;
+    return ns > timer_overhead ? ns - timer_overhead : 0;
+}
+
+/*
+ * Runs one operation over a sequence of keys.
+ * If "latencies" is not NULL, times every operation.
+ * Return: seconds used.
+ */
+double run(hashtable_t *h, const char *operation, void **sequence,
+           unsigned long count, unsigned long *latencies) {
+    unsigned long i, start = 0;
+    unsigned long found = 0;
+    double begin = now();
+
+    if (strcmp(operation, "get") == 0) {
+        for (i = 0; i < count; i++) {
+            if (latencies != NULL)
+                start = now_ns();
+            if (hashtable_get(h, sequence[i]) != NULL)
+                found++;
+            if (latencies != NULL)
+                latencies[i] = elapsed(start);
+        }
+    }
+    else if (strcmp(operation, "set") == 0) {
+        for (i = 0; i < count; i++) {
+            if (latencies != NULL)
+                start = now_ns();
+            hashtable_set(h, sequence[i], sequence[i]);
+            if (latencies != NULL)
+                latencies[i] = elapsed(start);
+        }
+    }
+    else {
+        for (i = 0; i < count; i++) {
+            if (latencies != NULL)
+                start = now_ns();
+            hashtable_delete_key(h, sequence[i]);
+            if (latencies != NULL)
+                latencies[i] = elapsed(start);
+        }
+    }
+
+    // Keeps the compiler from removing the lookups
+    if (found > count)
+        printf("?");
+
+    return now() - begin;
+}
+
+hashtable_t *create(workload_t *w) {
+    return hashtable_create_with_options(16, w->compare, w->hashvalue,
+                                         NULL, NULL, &w->options);
+}
+
+/*
+ * Inserts and deletes all keys of the workload, in rounds until "ops"
+ * operations are done.
+ */
+void run_insert_delete(workload_t *w, unsigned long ops, result_t *insert,
+                       result_t *delete, unsigned long *latencies,
+                       unsigned long *state) {
+    unsigned long rounds = (ops + w->n - 1) / w->n;
+    unsigned long *delete_latencies = latencies + rounds * w->n;
+    unsigned long r;
+    double insert_time = 0, delete_time = 0;
+    hashtable_t *h = NULL;
+    void **order = NULL;
+    void **delete_order = NULL;
+
+    order = (void **) malloc (w->n * sizeof(void*));
+    delete_order = (void **) malloc (w->n * sizeof(void*));
+    memcpy(order, w->keys, w->n * sizeof(void*));
+    memcpy(delete_order, w->keys, w->n * sizeof(void*));
+    shuffle(order, w->n, state);
+    shuffle(delete_order, w->n, state);
+
+    for (r = 0; r < rounds; r++) {
+        h = create(w);
+        insert_time += run(h, "set", order, w->n, NULL);
+        if (r == 0)
+            insert->rss = rss_bytes();
+        delete_time += run(h, "delete", delete_order, w->n, NULL);
+        hashtable_delete(h);
+    }
+    insert->ops = rounds * w->n / insert_time;
+    delete->ops = rounds * w->n / delete_time;
+    delete->rss = rss_bytes();
+
+    for (r = 0; r < rounds; r++) {
+        h = create(w);
+        run(h, "set", order, w->n, latencies + r * w->n);
+        run(h, "delete", delete_order, w->n, delete_latencies + r * w->n);
+        hashtable_delete(h);
+    }
+    percentiles(insert, latencies, rounds * w->n);
+    percentiles(delete, delete_latencies, rounds * w->n);
+
+    free(order);
+    free(delete_order);
+}
+
+/*
+ * Runs one phase on a full table: a run to measure operations per second and
+ * a run to measure latency.
+ */
+void run_phase(hashtable_t *h, const char *operation, void **sequence,
+               unsigned long ops, unsigned long *latencies, result_t *result) {
+    result->ops = ops / run(h, operation, sequence, ops, NULL);
+    run(h, operation, sequence, ops, latencies);
+    percentiles(result, latencies, ops);
+    result->rss = rss_bytes();
+}
+
+void print_result(result_t *result, result_t *baseline, int nbaseline,
+                  FILE *output) {
+    int i;
+
+    printf("%-34s %8.2fM %7lu %7lu %7lu %8.1f", result->name,
+           result->ops / 1e6, result->p50, result->p99, result->p999,
+           result->rss / 1048576.0);
+
+    for (i = 0; i < nbaseline; i++) {
+        if (strcmp(baseline[i].name, result->name) == 0) {
+            printf("   %+6.1f%% %+6.1f%%",
+                   (result->ops / baseline[i].ops - 1) * 100,
+                   baseline[i].p99 > 0
+                   ? ((double) result->p99 / baseline[i].p99 - 1) * 100 : 0);
+            break;
+        }
+    }
+    printf("\n");
+
+    if (output != NULL)
+        fprintf(output, "%s %.0f %lu %lu %lu %ld\n", result->name, result->ops,
+                result->p50, result->p99, result->p999, result->rss);
+}
+
+int load_baseline(const char *path, result_t *baseline) {
+    int n = 0;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+        return -1;
+    while (n < MAX_RESULTS &&
+           fscanf(file, "%63s %lf %lu %lu %lu %ld", baseline[n].name,
+                  &baseline[n].ops, &baseline[n].p50, &baseline[n].p99,
+                  &baseline[n].p999, &baseline[n].rss) == 6)
+        n++;
+    fclose(file);
+
+    return n;
+}
+
+/*
+ * Measures the cost of reading the clock, subtracted from every latency.
+ */
+void measure_timer_overhead() {
+    unsigned long i, start, ns, best = (unsigned long) -1;
+
+    for (i = 0; i < 100000; i++) {
+        start = now_ns();
+        ns = now_ns() - start;
+        if (ns < best)
+            best = ns;
+    }
+    timer_overhead = best;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    unsigned long max_keys = 1UL << 20;
+    unsigned long ops = 1UL << 20;
+    unsigned long sizes[] = {256, 4096, 65536, 1UL << 20, 1UL << 24};
+    unsigned long state = 88172645463325252UL;
+    unsigned long n, i, s, rounds;
+    int miss_percent = 50;
+    int key_type, distribution, option, nbaseline = 0;
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    const char *phases[] = {"insert", "get", "mixed", "update", "delete"};
+    result_t *baseline = NULL;
+    result_t results[5];
+    unsigned long *latencies = NULL;
+    void **sequence = NULL;
+    FILE *output = NULL;
+    hashtable_t *h = NULL;
+    workload_t w;
+    zipf_t zipf;
+    char buffer[32];
+
+    hashtable_options_init(&w.options);
+
+    while ((option = getopt(argc, argv, "k:n:m:ao:b:")) != -1) {
+        switch (option) {
+            case 'k': max_keys = strtoul(optarg, NULL, 10); break;
+            case 'n': ops = strtoul(optarg, NULL, 10); break;
+            case 'm': miss_percent = atoi(optarg); break;
+            case 'a': w.options.backend = HASHTABLE_BACKEND_OPEN_ADDRESSING;
+                      break;
+            case 'o': output_path = optarg; break;
+            case 'b': baseline_path = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-k max keys] [-n operations] "
+                        "[-m miss percent] [-a] [-o results] [-b baseline]\n",
+                        argv[0]);
+                return -1;
+        }
+    }
+    if (max_keys < sizes[0] || ops < 1 || miss_percent < 0 ||
+        miss_percent > 100)
+        return -1;
+
+    baseline = (result_t *) calloc (MAX_RESULTS, sizeof(result_t));
+    if (baseline == NULL)
+        return -1;
+    if (baseline_path != NULL) {
+        nbaseline = load_baseline(baseline_path, baseline);
+        if (nbaseline < 0) {
+            fprintf(stderr, "Error: cannot read %s\n", baseline_path);
+            return -1;
+        }
+    }
+    if (output_path != NULL) {
+        output = fopen(output_path, "w");
+        if (output == NULL) {
+            fprintf(stderr, "Error: cannot write %s\n", output_path);
+            return -1;
+        }
+    }
+
+    measure_timer_overhead();
+
+    printf("%s backend, %lu operations per phase, %d%% misses in \"mixed\", "
+           "latency in ns\n\n",
+           w.options.backend == HASHTABLE_BACKEND_CHAINED ? "chained"
+                                                          : "open addressing",
+           ops, miss_percent);
+    printf("%-34s %9s %7s %7s %7s %8s", "workload", "ops/sec", "p50", "p99",
+           "p999", "RSS MB");
+    if (nbaseline > 0)
+        printf("   %7s %7s", "ops/sec", "p99");
+    printf("\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= max_keys;
+         s++) {
+
+        n = sizes[s];
+        rounds = (ops + n - 1) / n;
+
+        latencies = (unsigned long *) malloc (
+            (rounds * n * 2 > ops ? rounds * n * 2 : ops) *
+            sizeof(unsigned long));
+        sequence = (void **) malloc (ops * sizeof(void*));
+        w.keys = (void **) malloc (n * sizeof(void*));
+        w.misses = (void **) malloc (n * sizeof(void*));
+        if (latencies == NULL || sequence == NULL || w.keys == NULL ||
+            w.misses == NULL)
+            return -1;
+
+        zipf_init(&zipf, n, ZIPF_THETA);
+
+        for (key_type = KEYS_INT; key_type <= KEYS_STRING; key_type++) {
+
+            w.key_type = key_type;
+            w.n = n;
+            if (key_type == KEYS_INT) {
+                w.compare = int_compare;
+                w.hashvalue = int_hash_value;
+                for (i = 0; i < n; i++) {
+                    w.keys[i] = (void *) (uintptr_t) (i + 1);
+                    w.misses[i] = (void *) (uintptr_t) (n + i + 1);
+                }
+            }
+            else {
+                w.compare = string_compare;
+                w.hashvalue = string_hash_value;
+                for (i = 0; i < n; i++) {
+                    sprintf(buffer, "key-%lu", i);
+                    w.keys[i] = strdup(buffer);
+                    sprintf(buffer, "miss-%lu", i);
+                    w.misses[i] = strdup(buffer);
+                    if (w.keys[i] == NULL || w.misses[i] == NULL)
+                        return -1;
+                }
+            }
+
+            for (distribution = DIST_UNIFORM; distribution <= DIST_ZIPF;
+                 distribution++) {
+
+                w.distribution = distribution;
+
+                run_insert_delete(&w, ops, &results[0], &results[4],
+                                  latencies, &state);
+
+                h = create(&w);
+                if (h == NULL)
+                    return -1;
+                for (i = 0; i < n; i++)
+                    hashtable_set(h, w.keys[i], w.keys[i]);
+
+                make_sequence(&w, &zipf, sequence, ops, 0, &state);
+                run_phase(h, "get", sequence, ops, latencies, &results[1]);
+                make_sequence(&w, &zipf, sequence, ops, miss_percent, &state);
+                run_phase(h, "get", sequence, ops, latencies, &results[2]);
+                make_sequence(&w, &zipf, sequence, ops, 0, &state);
+                run_phase(h, "set", sequence, ops, latencies, &results[3]);
+                hashtable_delete(h);
+
+                for (i = 0; i < 5; i++) {
+                    sprintf(results[i].name, "%s/%s/%lu/%s",
+                            key_type == KEYS_INT ? "int" : "string",
+                            distribution == DIST_UNIFORM ? "uniform" : "zipf",
+                            n, phases[i]);
+                    print_result(&results[i], baseline, nbaseline, output);
+                }
+            }
+
+            if (key_type == KEYS_STRING) {
+                for (i = 0; i < n; i++) {
+                    free(w.keys[i]);
+                    free(w.misses[i]);
+                }
+            }
+        }
+        printf("\n");
+
+        free(latencies);
+        free(sequence);
+        free(w.keys);
+        free(w.misses);
+    }
+
+    if (output != NULL)
+        fclose(output);
+    free(baseline);
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * Example 4
+ * Concurrent hash table used by several threads.
+ * Key = string
+ * Value = string
+ * Memory allocated when key is created, value is the same string.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "../hashtable_concurrent.h"
+
+#define THREADS 4
+#define KEYS_PER_THREAD 100000
+
+
+int string_compare(void *str1, void *str2) {
+    return strcmp((char*)str1, (char*)str2);
+}
+
+typedef struct _worker {
+    int id;
+    hashtable_concurrent_t *h;
+    int missing;
+} Worker;
+
+/*
+ * Every thread introduces its own keys and then reads the keys of the
+ * previous thread, which may not be there yet.
+ */
+void *worker_run(void *arg) {
+
+    Worker *worker = (Worker*) arg;
+    char buffer[32];
+    char *key = NULL;
+    int i;
+
+    for (i = 0; i < KEYS_PER_THREAD; i++) {
+        sprintf(buffer, "thread-%d-key-%d", worker->id, i);
+        key = strdup(buffer);
+        if (key == NULL || hashtable_concurrent_set(worker->h, key, key) != 0)
+            return NULL;
+    }
+
+    for (i = 0; i < KEYS_PER_THREAD; i++) {
+        sprintf(buffer, "thread-%d-key-%d", (worker->id + 1) % THREADS, i);
+        if (hashtable_concurrent_get(worker->h, buffer) == NULL)
+            worker->missing++;
+    }
+
+    return NULL;
+}
+
+
+int main() {
+
+    hashtable_concurrent_t *h = NULL;
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    int i;
+
+    // Keys are freed by the table, values are the same strings
+    h = hashtable_concurrent_create(16, 0, string_compare, string_hash_value,
+                                    free, NULL, NULL);
+    if (h == NULL)
+        return -1;
+
+    for (i = 0; i < THREADS; i++) {
+        workers[i].id = i;
+        workers[i].h = h;
+        workers[i].missing = 0;
+        pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+    }
+
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        printf("Thread %d: %d keys of thread %d not there yet\n",
+               i, workers[i].missing, (i + 1) % THREADS);
+    }
+
+    printf("\nKeys in table: %lu\n", hashtable_concurrent_count(h));
+    printf("thread-2-key-1234 - %s\n",
+           (char*) hashtable_concurrent_get(h, "thread-2-key-1234"));
+
+    hashtable_concurrent_delete(h);
+
+    return 0;
+}
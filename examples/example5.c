@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * Example 5
+ * Key = uint64_t (stored in the table, hashtable_u64_t)
+ * Value = struct (_hero)
+ * Heroes are found by their id, no key has to be allocated.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "../hashtable.h"
+
+
+/**** STRUCTURES **************************************************************/
+
+typedef struct _hero {
+    uint64_t id;
+    char *name;
+    /* ... */
+} Hero;
+
+
+/**** HERO FUNCTIONS **********************************************************/
+
+Hero *hero_create(uint64_t id, char *name) {
+
+    Hero *hero = (Hero*) malloc (sizeof(Hero));
+    if (hero == NULL)
+        return NULL;
+
+    hero->id = id;
+    hero->name = strdup(name);
+
+    return hero;
+}
+
+void hero_delete(void *hero) {
+    if (hero == NULL)
+        return;
+
+    free(((Hero*)hero)->name);
+    free(hero);
+}
+
+
+/**** MAIN ********************************************************************/
+
+int main() {
+
+    hashtable_u64_t *h = NULL;
+    char *heros[] = {"Batman", "Spiderman", "Wonder Woman", "Hulk", "Wolverine", "Goku"};
+    Hero *hero = NULL;
+    unsigned long position = 0;
+    uint64_t id;
+    int i;
+
+    h = hashtable_u64_create(100, hero_delete);
+
+    // Introduce heroes by id
+    for (i = 0; i < 6; i++) {
+        hero = hero_create(1000 + i, heros[i]);
+        hashtable_u64_set(h, hero->id, hero);
+    }
+
+    // Get heroes
+    for (i = 0; i < 6; i++) {
+        hero = hashtable_u64_get(h, 1000 + i);
+        printf("%lu - %s\n", (unsigned long) (1000 + i), hero->name);
+    }
+
+    printf("\n");
+
+    // Delete a hero (freed with hero_delete)
+    if (hashtable_u64_delete_key(h, 1003) == 0 &&
+        hashtable_u64_get(h, 1003) == NULL)
+        printf("Ok: Hulk deleted correctly.\n\n");
+    else
+        printf("Error: Hulk was not deleted.\n\n");
+
+    // Iterate over all heroes
+    while (hashtable_u64_next(h, &position, &id, (void **) &hero))
+        printf("%lu - %s\n", (unsigned long) id, hero->name);
+
+    hashtable_u64_delete(h);
+
+    return 0;
+}
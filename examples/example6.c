@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * Example 6
+ * Counting keys with several threads: every thread counts into its own shard
+ * without locks, and the shards are merged into one table at the end.
+ * Key = string
+ * Value = count (integer counter, hashtable_incr)
+ * Keys copied by the tables (intern_keys), counts stored in the values.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "../hashtable.h"
+
+#define THREADS 4
+#define LINES_PER_THREAD 200000
+#define USERS 1000
+#define TOP 3
+
+
+int string_compare(void *str1, void *str2) {
+    return strcmp((char*)str1, (char*)str2);
+}
+
+/*
+ * A user counted by several threads ends with the sum of its counts.
+ */
+void *count_add(void *count, void *other) {
+    return (void*) ((intptr_t) count + (intptr_t) other);
+}
+
+typedef struct _worker {
+    int id;
+    hashtable_t *shard;
+} Worker;
+
+/*
+ * Every thread counts the users of its own "log lines" in its shard.
+ */
+void *worker_run(void *arg) {
+
+    Worker *worker = (Worker*) arg;
+    unsigned int seed = worker->id + 1;
+    char buffer[32];
+    int i;
+
+    for (i = 0; i < LINES_PER_THREAD; i++) {
+        sprintf(buffer, "user-%d", rand_r(&seed) % USERS);
+
+        // New users are copied by the shard and start at 0
+        if (hashtable_incr(worker->shard, buffer, 1, NULL) < 0)
+            return NULL;
+    }
+
+    return NULL;
+}
+
+
+int main() {
+
+    hashtable_t **shards = NULL;
+    hashtable_t *h = NULL;
+    hashtable_options_t options;
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    void *top_users[TOP];
+    long top_counts[TOP];
+    unsigned long top;
+    unsigned long j;
+    int i;
+
+    // Keys are copied into the arenas of the tables
+    hashtable_options_init(&options);
+    options.intern_keys = 1;
+    shards = hashtable_create_shards(THREADS, 256, string_compare,
+                                     string_hash_value, NULL, NULL,
+                                     &options);
+    if (shards == NULL)
+        return -1;
+
+    for (i = 0; i < THREADS; i++) {
+        workers[i].id = i;
+        workers[i].shard = shards[i];
+        pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+    }
+
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        printf("Shard %d: %lu users\n", i, hashtable_count(shards[i]));
+    }
+
+    // Merged with one thread per range of buckets of the final table
+    options.threads = THREADS;
+    h = hashtable_create_with_options(16, string_compare, string_hash_value,
+                                      NULL, NULL, &options);
+    if (h == NULL || hashtable_merge_shards(h, shards, THREADS,
+                                            count_add) != 0)
+        return -1;
+
+    printf("\nUsers in table: %lu\n", hashtable_count(h));
+    printf("user-42 - %ld lines\n",
+           (long) (intptr_t) hashtable_get(h, "user-42"));
+
+    // Read from the table, nothing copied
+    top = hashtable_top_k(h, TOP, top_users, top_counts);
+    printf("\nTop %lu users:\n", top);
+    for (j = 0; j < top; j++)
+        printf("%s - %ld lines\n", (char*) top_users[j], top_counts[j]);
+
+    hashtable_delete_shards(shards, THREADS);
+    hashtable_delete(h);
+
+    return 0;
+}
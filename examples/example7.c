@@ -0,0 +1,86 @@
+/*******************************************************************************
+ * Example 7
+ * Hash table with a write-ahead log: changes survive the end of the process
+ * and the table is replayed from the log when opened again.
+ * Key = string
+ * Value = string
+ * Keys and values copied by the table, the log stores their bytes.
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../hashtable_wal.h"
+
+#define LOG "example7.wal"
+#define USERS 10000
+
+
+int main() {
+
+    hashtable_wal_t *wal = NULL;
+    hashtable_wal_options_t wal_options;
+    char key[32], value[32];
+    int i;
+
+    // Start from an empty log
+    unlink(LOG);
+    unlink(LOG ".snapshot");
+
+    hashtable_wal_options_init(&wal_options);
+    wal_options.batch_bytes = 16 << 10;
+
+    wal = hashtable_wal_open(LOG, 16, NULL, string_hash_value, NULL,
+                             &wal_options);
+    if (wal == NULL)
+        return -1;
+
+    // Batches of changes are written and synced together
+    for (i = 0; i < USERS; i++) {
+        sprintf(key, "user-%d", i);
+        sprintf(value, "%d points", i % 100);
+        if (hashtable_wal_set(wal, key, value) != 0)
+            return -1;
+    }
+    hashtable_wal_delete_key(wal, "user-7");
+
+    if (hashtable_wal_commit(wal) != 0)
+        return -1;
+
+    printf("Users before closing: %lu\n",
+           hashtable_count(hashtable_wal_table(wal)));
+    hashtable_wal_close(wal);
+
+    // Replayed from the log
+    wal = hashtable_wal_open(LOG, 16, NULL, string_hash_value, NULL,
+                             &wal_options);
+    if (wal == NULL)
+        return -1;
+
+    printf("Users after opening: %lu\n",
+           hashtable_count(hashtable_wal_table(wal)));
+    printf("user-42 - %s\n", (char*) hashtable_wal_get(wal, "user-42"));
+    printf("user-7 - %s\n", hashtable_wal_get(wal, "user-7") != NULL
+                             ? "found" : "deleted");
+
+    // The log is saved to a snapshot and emptied
+    hashtable_wal_set(wal, "user-7", "1 point");
+    if (hashtable_wal_compact(wal) != 0)
+        return -1;
+    hashtable_wal_close(wal);
+
+    wal = hashtable_wal_open(LOG, 16, NULL, string_hash_value, NULL, NULL);
+    if (wal == NULL)
+        return -1;
+
+    printf("\nUsers after compacting: %lu\n",
+           hashtable_count(hashtable_wal_table(wal)));
+    printf("user-7 - %s\n", (char*) hashtable_wal_get(wal, "user-7"));
+
+    hashtable_wal_close(wal);
+    unlink(LOG);
+    unlink(LOG ".snapshot");
+
+    return 0;
+}
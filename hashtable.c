@@ -7,28 +7,101 @@
  * Date: 1 July 2016
  ******************************************************************************/
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "hashtable.h"
+#include "hashtable_group.h"
 
+#if defined(__GNUC__)
+#define HASHTABLE_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define HASHTABLE_PREFETCH(address) ((void) (address))
+#endif
 
-/**** FUNCTION POINTERS *******************************************************/
+
+/**** DEFAULT OPTIONS *********************************************************/
+
+#define HASHTABLE_DEFAULT_MAX_LOAD_FACTOR 1.0f
+#define HASHTABLE_DEFAULT_MIN_LOAD_FACTOR 0.0f
+#define HASHTABLE_DEFAULT_REHASH_STEP     4
+#define HASHTABLE_DEFAULT_EXPIRE_STEP     4
 
 /*
- * Pointer to function that compare two keys.
- * Return: (= 0) key1 = key2, (< 0) key1 < key2, (> 0) key1 > key2.
+ * Number of keys of a batch operation that are hashed and prefetched
+ * together. Enough to overlap the memory latency of several keys, small
+ * enough for the prefetched lines to stay in L1.
  */
-typedef int (*fp_compare_keys)(void *key1, void *key2);
+#define HASHTABLE_BATCH_CHUNK             16
 
 /*
- * Pointer to function that calculates the hash value of a key.
- * Return: Hash value of key.
+ * Maximum number of worker threads of the parallel operations.
+ */
+#define HASHTABLE_MAX_THREADS             256
+
+/*
+ * Maximum number of empty buckets visited per moved bucket in a rehash step,
+ * so a sparse table cannot turn a single call into a long walk.
+ */
+#define HASHTABLE_REHASH_EMPTY_VISITS     10
+
+/*
+ * Minimum number of old buckets per thread of a parallel resize. Smaller
+ * resizes (and tables with one thread) are done incrementally.
+ */
+#define HASHTABLE_REHASH_THREAD_BUCKETS   16384
+
+
+/**** ALLOCATOR CONSTANTS *****************************************************/
+
+/*
+ * Huge page size of the built-in huge page allocator. Smaller blocks are
+ * allocated with malloc, larger ones are mapped in multiples of it.
+ */
+#define HASHTABLE_HUGE_PAGE_SIZE          (2UL << 20)
+
+/*
+ * NUMA nodes the built-in huge page allocator can bind to, and the memory
+ * policy it uses (MPOL_PREFERRED: the node if it has memory, any other if
+ * not).
+ */
+#define HASHTABLE_NUMA_MAX_NODES          1024
+#define HASHTABLE_MPOL_PREFERRED          1
+
+
+/**** ARENA CONSTANTS *********************************************************/
+
+/*
+ * Interned keys and values are copied into chunks of at least
+ * HASHTABLE_ARENA_MIN_CHUNK bytes, every new chunk doubling the size of the
+ * previous one up to HASHTABLE_ARENA_MAX_CHUNK bytes.
  */
-typedef unsigned long (*fp_hashvalue)(void *key);
+#define HASHTABLE_ARENA_MIN_CHUNK (64 * 1024)
+#define HASHTABLE_ARENA_MAX_CHUNK (16 * 1024 * 1024)
+
+
+/**** TIMER WHEEL CONSTANTS ***************************************************/
 
 /*
- * Pointer to function that frees allocated memory of a key or value.
- * You don't need it if you don't allocate memory.
+ * Keys with a time to live are linked in a hierarchical timing wheel of
+ * HASHTABLE_WHEEL_LEVELS levels of HASHTABLE_WHEEL_SLOTS lists. Level 0 has
+ * a list per millisecond, every level above a list per
+ * HASHTABLE_WHEEL_SLOTS lists of the level below (64 ms, 4 s, 4.6 hours);
+ * later expirations wait in the top level. HASHTABLE_TIMER_NONE ends a list.
  */
-typedef void (*fp_delete)(void *key_or_value);
+#define HASHTABLE_WHEEL_LEVELS 4
+#define HASHTABLE_WHEEL_BITS   6
+#define HASHTABLE_WHEEL_SLOTS  (1 << HASHTABLE_WHEEL_BITS)
+#define HASHTABLE_TIMER_NONE   ((unsigned long) -1)
 
 
 /**** STRUCTURES **************************************************************/
@@ -36,299 +109,5513 @@ typedef void (*fp_delete)(void *key_or_value);
 struct hashnode_s {
     void *key;
     void *value;
+    unsigned long hash;
     struct hashnode_s *next;
 };
 
+struct hashslot_s {
+    void *key;
+    void *value;
+};
+
+struct hashslot_u64_s {
+    uint64_t key;
+    void *value;
+};
+
+/*
+ * Timing wheel of a table with a time to live. "tick" is the next millisecond
+ * to process, all keys expiring before it are gone. Lists are linked through
+ * the "timer_next" and "timer_prev" arrays of the table; the "timer_prev" of
+ * the first slot of a list is the table size plus the index of the list in
+ * "lists", so a slot can be unlinked without knowing its list.
+ */
+struct hashwheel_s {
+    uint64_t tick;
+    unsigned long timers;
+    unsigned long lists[HASHTABLE_WHEEL_LEVELS * HASHTABLE_WHEEL_SLOTS];
+};
+
+/*
+ * Chunk of the arena of a table. Copies are bump allocated from "data", each
+ * one preceded by its length in a uint64_t and padded to 8 bytes.
+ */
+struct hasharena_s {
+    struct hasharena_s *next;
+    size_t size;
+    unsigned char data[];
+};
+
+/*
+ * Block of "size" nodes of a node pool. Slabs are only freed with the table.
+ */
+struct hashslab_s {
+    struct hashslab_s *next;
+    unsigned long size;
+    struct hashnode_s nodes[];
+};
+
+/*
+ * While the table is being resized there are two bucket arrays: "table" (the
+ * old one) and "rehash_table" (the new one). Buckets of "table" below
+ * "rehash_index" have already been moved, so a key lives in "rehash_table" if
+ * its old bucket is below "rehash_index", and in "table" otherwise.
+ *
+ * Open addressing tables use "ctrl" and "slots" instead of the bucket arrays,
+ * and "size" is their number of slots.
+ *
+ * Mapped tables (opened with hashtable_open_mapped()) read a snapshot file
+ * mapped at "map", and "size" is its number of buckets.
+ *
+ * While "iterators" is greater than 0 resizes are paused, so iterators do not
+ * miss or repeat keys. Iterators are linked in "iterator_list", so deleting
+ * the next node of an iterator moves it forward.
+ *
+ * With "intern_keys" (or "intern_values") set keys (values) are copies made
+ * by the table in its arena, the list of chunks "arena" whose head has
+ * "arena_used" bytes used. Keys are compared by length and bytes instead of
+ * with "compare".
+ *
+ * With "counters" set lookups update "lookups", "hits", "misses" and
+ * "probes" (see hashtable_count_lookup()).
+ *
+ * A cache (open addressing table with "max_entries" or "max_bytes" set) has a
+ * reference byte per slot in "referenced", set when the slot is used, and
+ * with "max_bytes" the bytes charged for every slot in "charges", adding up
+ * to "bytes". Both arrays follow the slots in the allocation of "ctrl".
+ * "hand" is the next slot looked at to evict a key (see hashtable_evict()).
+ *
+ * With "ttl" set (also an open addressing table) "expires" has the
+ * millisecond at which the key of every slot expires (0 never), and keys
+ * with a time to live are linked in the timing wheel "wheel".
+ *
+ * With a node pool ("slab_size" > 0) nodes come from "free_nodes", a list of
+ * released nodes linked by "next", or else from the unused tail of the newest
+ * slab ("slabs" list head), whose first "slab_used" nodes are already given.
+ *
+ * All memory of the table, but keys and values, comes from "allocator".
+ */
 struct hashtable_s {
+    hashtable_backend_t backend;
     unsigned long size;
+    unsigned long count;
     struct hashnode_s **table;
+    unsigned long rehash_size;
+    unsigned long rehash_index;
+    struct hashnode_s **rehash_table;
+    unsigned long min_size;
+    float max_load_factor;
+    float min_load_factor;
+    unsigned long rehash_step;
+    int exact_size;
+    unsigned int threads;
+    unsigned long iterators;
+    hashtable_iterator_t *iterator_list;
+    int counters;
+    atomic_ulong lookups;
+    atomic_ulong hits;
+    atomic_ulong misses;
+    atomic_ulong probes;
+    signed char *ctrl;
+    struct hashslot_s *slots;
+    unsigned char *referenced;
+    size_t *charges;
+    unsigned long hand;
+    unsigned long max_entries;
+    size_t max_bytes;
+    size_t bytes;
+    unsigned long evictions;
+    fp_evict evict;
+    void *evict_data;
+    uint64_t *expires;
+    unsigned long *timer_next;
+    unsigned long *timer_prev;
+    struct hashwheel_s *wheel;
+    unsigned long expire_step;
+    unsigned long expirations;
+    unsigned char *map;
+    size_t map_size;
+    unsigned long tombstones;
+    unsigned long slab_size;
+    unsigned long slab_used;
+    struct hashslab_s *slabs;
+    struct hashnode_s *free_nodes;
+    int intern_keys;
+    int intern_values;
+    fp_length key_length;
+    fp_length value_length;
+    struct hasharena_s *arena;
+    size_t arena_used;
+    size_t arena_bytes;
     fp_compare_keys compare;
     fp_hashvalue hashvalue;
+    fp_hashvalue_seeded hashvalue_seeded;
+    unsigned long seed;
     fp_delete key_delete;
     fp_delete value_delete;
+    hashtable_allocator_t allocator;
+};
+
+/*
+ * Snapshot file, written by hashtable_save(). All positions are offsets from
+ * the start of the file, so it can be mapped at any address. The file is the
+ * header, the array of "size" bucket offsets (0 is an empty bucket) and the
+ * entries, each one followed by its key and value bytes, both padded to 8
+ * bytes. Entries of a bucket are contiguous and linked by "next" (0 ends the
+ * list). Numbers are in the byte order of the machine that wrote the file,
+ * "byte_order" is HASHSNAPSHOT_BYTE_ORDER in that order.
+ */
+#define HASHSNAPSHOT_MAGIC       "HTSNAP01"
+#define HASHSNAPSHOT_BYTE_ORDER  UINT64_C(0x0102030405060708)
+#define HASHSNAPSHOT_EXACT_SIZE  1
+#define HASHSNAPSHOT_NULL_VALUE  UINT64_MAX
+
+struct hashsnapshot_header_s {
+    char magic[8];
+    uint64_t byte_order;
+    uint64_t flags;
+    uint64_t seed;
+    uint64_t count;
+    uint64_t size;
+    uint64_t buckets;
+    uint64_t file_size;
+};
+
+struct hashsnapshot_entry_s {
+    uint64_t next;
+    uint64_t hash;
+    uint64_t key_length;
+    uint64_t value_length;
+};
+
+/*
+ * Table of integer keys, an open addressing table (see HASHTABLE_GROUP_WIDTH)
+ * whose slots store the key itself. Keys are hashed by mixing them with
+ * "seed".
+ */
+struct hashtable_u64_s {
+    signed char *ctrl;
+    struct hashslot_u64_s *slots;
+    unsigned long size;
+    unsigned long count;
+    unsigned long tombstones;
+    uint64_t seed;
+    fp_delete value_delete;
 };
 
 typedef struct hashnode_s hashnode_t;
-typedef struct hashtable_s hashtable_t;
+typedef struct hashsnapshot_header_s hashsnapshot_header_t;
+typedef struct hashsnapshot_entry_s hashsnapshot_entry_t;
+typedef struct hashslot_s hashslot_t;
+typedef struct hashslot_u64_s hashslot_u64_t;
+typedef struct hashslab_s hashslab_t;
+typedef struct hasharena_s hasharena_t;
+typedef struct hashwheel_s hashwheel_t;
+
+
+/**** ALLOCATOR FUNCTIONS *****************************************************/
+
+static void *hashtable_malloc(size_t size, void *context) {
+
+    (void) context;
+    return malloc(size);
+}
+
+static void hashtable_malloc_free(void *pointer, size_t size, void *context) {
+
+    (void) size;
+    (void) context;
+    free(pointer);
+}
 
+static void *hashtable_malloc_realloc(void *pointer, size_t old_size,
+                                      size_t size, void *context) {
 
-/**** HASHNODE FUNCTIONS ******************************************************/
+    (void) old_size;
+    (void) context;
+    return realloc(pointer, size);
+}
 
 /*
- * Creates a new key-value node.
- * Parameter "key" cannot be NULL.
- * Return: Node created or NULL if an error ocurred.
+ * Allocator of the tables created without one.
  */
-hashnode_t *hashnode_create(void *key, void *value, hashnode_t *next) {
+static const hashtable_allocator_t hashtable_default_allocator = {
+    hashtable_malloc, hashtable_malloc_free, hashtable_malloc_realloc, NULL
+};
 
-    hashnode_t *node = NULL;
+/*
+ * Return: "size" bytes from the allocator of a table, NULL if there is no
+ * memory.
+ */
+static void *hashtable_alloc(hashtable_t *hashtable, size_t size) {
 
-    if (key == NULL)
-        return NULL;
+    return hashtable->allocator.alloc(size, hashtable->allocator.context);
+}
 
-    node = (hashnode_t *) malloc (sizeof(hashnode_t));
-    if (node == NULL)
-        return NULL;
+/*
+ * Return: "size" bytes set to 0 from the allocator of a table, NULL if there
+ * is no memory.
+ */
+static void *hashtable_zalloc(hashtable_t *hashtable, size_t size) {
 
-    node->key = key;
-    node->value = value;
-    node->next = next;
+    void *pointer = hashtable_alloc(hashtable, size);
 
-    return node;
+    if (pointer != NULL)
+        memset(pointer, 0, size);
+
+    return pointer;
 }
 
 /*
- * Free allocated memory from one node. You should free key and value, if
- * needed, before calling this function.
+ * Returns a block of "size" bytes to the allocator of a table.
  */
-void hashnode_delete(hashnode_t *node) {
+static void hashtable_free(hashtable_t *hashtable, void *pointer,
+                           size_t size) {
 
-    if (node == NULL)
-        return;
+    if (pointer != NULL)
+        hashtable->allocator.free(pointer, size, hashtable->allocator.context);
+}
 
-    free(node);
-    return;
+/*
+ * Resizes a block of "old_size" bytes of the allocator of a table.
+ * Return: Block of "size" bytes, NULL if there is no memory (the block is not
+ * changed).
+ */
+static void *hashtable_realloc(hashtable_t *hashtable, void *pointer,
+                               size_t old_size, size_t size) {
+
+    return hashtable->allocator.realloc(pointer, old_size, size,
+                                        hashtable->allocator.context);
 }
 
+/*
+ * Return: 1 if both tables allocate memory the same way, so one can free the
+ * memory of the other, 0 if not.
+ */
+static int hashtable_same_allocator(hashtable_t *hashtable,
+                                    hashtable_t *other) {
 
-/**** HASHTABLE FUNCTIONS *****************************************************/
+    return hashtable->allocator.alloc == other->allocator.alloc &&
+           hashtable->allocator.free == other->allocator.free &&
+           hashtable->allocator.context == other->allocator.context;
+}
 
 /*
- * Creates a new hash table.
- * Parameter "size" must be greater than 0.
- * Parameter "compare_function" cannot be NULL, is needed to compare keys.
- * Parameter "hashvalue_function" cannot be NULL, is needed to calculate key
- * position in the hash table.
- * Parameter "key_delete_function" is used to free allocated memory for a key,
- * this paremeter can be NULL if no memory was allocated with malloc or similar.
- * Parameter "value_delete_function" is used to free allocated memory for a
- * value, this paremeter can be NULL if no memory was allocated with malloc or
- * similar.
- * Return: NULL if error, pointer to hashtable on success.
+ * Return: Number of bytes mapped for a block of "size" bytes of the huge page
+ * allocator.
  */
- hashtable_t *hashtable_create(unsigned long size,
-                               fp_compare_keys compare_function,
-                               fp_hashvalue hashvalue_function,
-                               fp_delete key_delete_function,
-                               fp_delete value_delete_function) {
+static size_t hashtable_huge_length(size_t size) {
 
-    hashtable_t *hashtable = NULL;
-    int i;
+    return (size + HASHTABLE_HUGE_PAGE_SIZE - 1) &
+           ~(HASHTABLE_HUGE_PAGE_SIZE - 1);
+}
 
-    if (size < 1 || compare_function == NULL || hashvalue_function == NULL)
-        return NULL;
+/*
+ * Allocates a block of the huge page allocator. Large blocks are mapped
+ * aligned to a huge page, so they can be backed by transparent huge pages,
+ * and bound to the NUMA node of "context" (node + 1, 0 for none). Both are
+ * only advice to the kernel, they never make the allocation fail.
+ * Return: Block of "size" bytes, NULL if there is no memory.
+ */
+static void *hashtable_huge_alloc(size_t size, void *context) {
 
-    hashtable = (hashtable_t *) malloc (sizeof(hashtable_t));
-    if (hashtable == NULL)
-        return NULL;
+    unsigned long mask[HASHTABLE_NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+    long node = (long) (intptr_t) context - 1;
+    size_t length;
+    char *map = NULL;
+    char *start = NULL;
 
-    hashtable->size = size;
-    hashtable->table = (hashnode_t **) malloc (size * sizeof(hashnode_t*));
-    if (hashtable->table == NULL)
+    if (size < HASHTABLE_HUGE_PAGE_SIZE)
+        return malloc(size);
+
+    // One more huge page to align the start of the block
+    length = hashtable_huge_length(size);
+    map = (char *) mmap(NULL, length + HASHTABLE_HUGE_PAGE_SIZE,
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+    if (map == MAP_FAILED)
         return NULL;
 
-    for (i = 0; i < size; i++)
-        hashtable->table[i] = NULL;
+    start = (char *) (((uintptr_t) map + HASHTABLE_HUGE_PAGE_SIZE - 1) &
+                      ~(uintptr_t) (HASHTABLE_HUGE_PAGE_SIZE - 1));
+    if (start > map)
+        munmap(map, start - map);
+    if (start + length < map + length + HASHTABLE_HUGE_PAGE_SIZE)
+        munmap(start + length,
+               map + length + HASHTABLE_HUGE_PAGE_SIZE - (start + length));
 
-    hashtable->compare = compare_function;
-    hashtable->hashvalue = hashvalue_function;
-    hashtable->key_delete = key_delete_function;
-    hashtable->value_delete = value_delete_function;
+#if defined(MADV_HUGEPAGE)
+    madvise(start, length, MADV_HUGEPAGE);
+#endif
 
-    return hashtable;
-}
+#if defined(SYS_mbind)
+    if (node >= 0) {
+        memset(mask, 0, sizeof(mask));
+        mask[node / (8 * sizeof(unsigned long))] =
+            1UL << (node % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, start, length, HASHTABLE_MPOL_PREFERRED, mask,
+                HASHTABLE_NUMA_MAX_NODES + 1, 0);
+    }
+#else
+    (void) mask;
+    (void) node;
+#endif
 
+    return start;
+}
 
 /*
- * Calculates in which position of the hash table the key goes.
- * Return: Calculated position.
+ * Frees a block of "size" bytes of the huge page allocator.
  */
-unsigned long hashtable_calculate_key_position(hashtable_t *hashtable, void *key){
+static void hashtable_huge_free(void *pointer, size_t size, void *context) {
 
-    return hashtable->hashvalue(key) % hashtable->size;
+    (void) context;
+
+    if (size < HASHTABLE_HUGE_PAGE_SIZE)
+        free(pointer);
+    else
+        munmap(pointer, hashtable_huge_length(size));
 }
 
 /*
- * If the key doesn't exist in the hash table a new key-value pair is introduced
- * into the hash table, if it exist, it replaces the value with the one passed
- * as parameter.
- * Parameter "value" can be NULL.
- * Return: 0 on success, -1 on error.
+ * Resizes a block of the huge page allocator. Blocks that stay small are
+ * resized by realloc(), the others are copied.
+ * Return: Block of "size" bytes, NULL if there is no memory.
  */
-int hashtable_set(hashtable_t *hashtable, void *key, void *value) {
+static void *hashtable_huge_realloc(void *pointer, size_t old_size,
+                                    size_t size, void *context) {
 
-    unsigned long key_pos = 0;
-    hashnode_t *node = NULL;
+    void *block = NULL;
 
-    if (hashtable == NULL || key == NULL)
-        return -1;
+    if (old_size < HASHTABLE_HUGE_PAGE_SIZE && size < HASHTABLE_HUGE_PAGE_SIZE)
+        return realloc(pointer, size);
 
-    key_pos = hashtable_calculate_key_position(hashtable, key);
+    // A mapping already holds any size up to its length
+    if (old_size >= HASHTABLE_HUGE_PAGE_SIZE &&
+        size >= HASHTABLE_HUGE_PAGE_SIZE &&
+        hashtable_huge_length(old_size) == hashtable_huge_length(size))
+        return pointer;
 
-    node = hashtable->table[key_pos];
+    block = hashtable_huge_alloc(size, context);
+    if (block == NULL)
+        return NULL;
 
-    // First position of list != NULL
-    while (node != NULL) {
-        if (hashtable->compare(key, node->key) == 0) {
+    memcpy(block, pointer, old_size < size ? old_size : size);
+    hashtable_huge_free(pointer, old_size, context);
 
-            if(hashtable->value_delete != NULL)
-                hashtable->value_delete(node->value);
+    return block;
+}
 
-            node->value = value;
-            return 0;
-        }
-        else if (node->next == NULL) {
-            node->next = hashnode_create(key, value, NULL);
-            if(node->next == NULL)
-                return -1;
-            return 0;
-        }
-        else {
-            node = node->next;
-        }
-    }
+/*
+ * Fills "allocator" with the built-in huge page allocator.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_allocator_huge_pages(hashtable_allocator_t *allocator,
+                                   int numa_node) {
 
-    //First position of list == NULL
-    node = hashnode_create(key, value, NULL);
-    if(node == NULL)
+    if (allocator == NULL || numa_node < -1 ||
+        numa_node >= HASHTABLE_NUMA_MAX_NODES)
         return -1;
-    hashtable->table[key_pos] = node;
+
+    allocator->alloc = hashtable_huge_alloc;
+    allocator->free = hashtable_huge_free;
+    allocator->realloc = hashtable_huge_realloc;
+    allocator->context = (void *) (intptr_t) (numa_node + 1);
+
     return 0;
 }
 
+
+/**** BUCKET SELECTION FUNCTIONS **********************************************/
+
 /*
- * Gets the value associated to a key.
- * Return: NULL on error, value on success.
+ * Mixes the bits of a hash value (MurmurHash3 finalizer), so every bit of the
+ * result depends on all bits of the original hash. Hash functions with weak
+ * low bits, like djb2, would otherwise fill only a few buckets.
+ * Return: Mixed hash value.
  */
-void *hashtable_get(hashtable_t *hashtable, void *key){
+static uint64_t hashtable_mix(uint64_t hash) {
 
-    unsigned long key_pos = 0;
-    hashnode_t *node = NULL;
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xc4ceb9fe1a85ec53);
+    hash ^= hash >> 33;
 
-    if (hashtable == NULL || key == NULL)
-        return NULL;
+    return hash;
+}
 
-    key_pos = hashtable_calculate_key_position(hashtable, key);
+/*
+ * Maps a mixed hash value to [0, size) with a multiplication and a shift
+ * instead of a division (Lemire's fastrange). It uses the high bits of
+ * "mixed".
+ * Return: Calculated position.
+ */
+static unsigned long hashtable_fastrange(uint64_t mixed, unsigned long size) {
 
-    node = hashtable->table[key_pos];
+#if defined(__SIZEOF_INT128__)
+    return (unsigned long) (((unsigned __int128) mixed * size) >> 64);
+#else
+    if ((uint64_t) size <= UINT32_MAX)
+        return (unsigned long) (((mixed >> 32) * size) >> 32);
+    return (unsigned long) (mixed % size);
+#endif
+}
 
-    while (node != NULL) {
-        if (hashtable->compare(key, node->key) == 0) {
-            return node->value;
-        }
-        else {
-            node = node->next;
-        }
-    }
+/*
+ * Rounds a number of buckets up to a power of two.
+ * Return: Calculated size, or "size" if it cannot be rounded up.
+ */
+static unsigned long hashtable_round_pow2(unsigned long size) {
 
-    return NULL;
+    unsigned long rounded = 1;
+
+    while (rounded < size && rounded * 2 > rounded)
+        rounded *= 2;
+
+    return rounded < size ? size : rounded;
 }
 
 /*
- * Deletes a key and its associated value from a hash table.
- * Return: -1 on error, 0 on success.
+ * Calculates in which position of a bucket array of "size" buckets a hash
+ * value goes. Sizes are powers of two, except with the "exact_size" option.
+ * Return: Calculated position.
  */
-int hashtable_delete_key(hashtable_t *hashtable, void *key) {
+unsigned long hashtable_calculate_key_position(hashtable_t *hashtable,
+                                               unsigned long hash,
+                                               unsigned long size) {
 
-    unsigned long key_pos = 0;
-    hashnode_t *node = NULL;
-    hashnode_t *node_aux = NULL;
+    uint64_t mixed = hashtable_mix(hash);
+
+    if (hashtable->exact_size)
+        return hashtable_fastrange(mixed, size);
+
+    return (unsigned long) mixed & (size - 1);
+}
 
-    if (hashtable == NULL || key == NULL)
-        return -1;
 
-    key_pos = hashtable_calculate_key_position(hashtable, key);
+/**** SEED FUNCTIONS **********************************************************/
 
-    node = hashtable->table[key_pos];
+/*
+ * Seed of string_hash_value(), chosen once per process. 0 means not chosen.
+ * Seeds of tables are derived from it.
+ */
+static _Atomic uint64_t hashtable_process_seed = 0;
 
-    // First position in list
-    if (node != NULL && hashtable->compare(key, node->key) == 0) {
-        hashtable->table[key_pos] = node->next;
+/*
+ * Generates a random seed, from /dev/urandom if possible, otherwise from the
+ * time, the clock and some addresses.
+ * Return: Random seed, never 0.
+ */
+static uint64_t hashtable_random_seed(void) {
 
-		if (hashtable->key_delete != NULL)
-			hashtable->key_delete(node->key);
-		if (hashtable->value_delete != NULL)
-			hashtable->value_delete(node->value);
+    uint64_t seed = 0;
+    FILE *urandom = NULL;
 
-        hashnode_delete(node);
-        return 0;
+    urandom = fopen("/dev/urandom", "rb");
+    if (urandom != NULL) {
+        if (fread(&seed, sizeof(seed), 1, urandom) != 1)
+            seed = 0;
+        fclose(urandom);
     }
 
-    // Other position in list
-    while (node != NULL) {
+    seed ^= hashtable_mix((uint64_t) time(NULL) ^
+                          ((uint64_t) clock() << 32) ^
+                          (uint64_t) (uintptr_t) &seed ^
+                          (uint64_t) (uintptr_t) &hashtable_random_seed);
+
+    return seed != 0 ? seed : 1;
+}
 
-        node_aux = node;
-        node = node->next;
+/*
+ * Return: Seed of string_hash_value() for this process.
+ */
+static uint64_t hashtable_get_process_seed(void) {
 
-        if (hashtable->compare(key, node->key) == 0) {
-            node_aux->next = node->next->next;
+    uint64_t seed = atomic_load(&hashtable_process_seed);
+    uint64_t expected = 0;
 
-            if (hashtable->key_delete != NULL)
-    			hashtable->key_delete(node->key);
-    		if (hashtable->value_delete != NULL)
-    			hashtable->value_delete(node->value);
+    if (seed != 0)
+        return seed;
 
-            hashnode_delete(node);
-            return 0;
-        }
-    }
+    // Several threads may race here, all of them use the first stored seed
+    seed = hashtable_random_seed();
+    if (!atomic_compare_exchange_strong(&hashtable_process_seed, &expected,
+                                        seed))
+        seed = expected;
 
-    return 0;
+    return seed;
 }
 
 /*
- * Frees all allocated memory in a hash table.
+ * Derives a new seed for a table from the seed of the process and a
+ * counter, without reading /dev/urandom again.
+ * Return: Seed, never 0.
  */
-void hashtable_delete(hashtable_t *hashtable) {
+static uint64_t hashtable_table_seed(void) {
 
-    hashnode_t *node = NULL;
-    hashnode_t *node_aux = NULL;
-    int i;
+    static _Atomic uint64_t counter = 0;
+    uint64_t seed;
 
-    if (hashtable == NULL)
-        return;
+    seed = hashtable_mix(hashtable_get_process_seed() ^
+                         hashtable_mix(atomic_fetch_add(&counter, 1) + 1));
 
-    for (i = 0; i < hashtable->size; i++) {
-        node = hashtable->table[i];
+    return seed != 0 ? seed : 1;
+}
 
-        //delete all possible lists
-        while (node != NULL) {
-            node_aux = node;
-            node = node->next;
 
-            if (hashtable->key_delete != NULL)
-    			hashtable->key_delete(node_aux->key);
-    		if (hashtable->value_delete != NULL)
-    			hashtable->value_delete(node_aux->value);
+/**** NODE POOL FUNCTIONS *****************************************************/
+
+/*
+ * Creates a new key-value node, taking it from the node pool of the table if
+ * it has one.
+ * Return: Node created or NULL if an error ocurred.
+ */
+static hashnode_t *hashtable_node_create(hashtable_t *hashtable, void *key,
+                                         void *value, unsigned long hash,
+                                         hashnode_t *next) {
+
+    hashnode_t *node = NULL;
+    hashslab_t *slab = NULL;
 
-            hashnode_delete(node_aux);
-			node_aux = NULL;
+    if (hashtable->slab_size == 0) {
+        node = (hashnode_t *) hashtable_alloc(hashtable, sizeof(hashnode_t));
+        if (node == NULL)
+            return NULL;
+    }
+    else if (hashtable->free_nodes != NULL) {
+        node = hashtable->free_nodes;
+        hashtable->free_nodes = node->next;
+    }
+    else {
+        if (hashtable->slabs == NULL ||
+            hashtable->slab_used == hashtable->slabs->size) {
+            slab = (hashslab_t *) hashtable_alloc(hashtable,
+                                                  sizeof(hashslab_t) +
+                                                  hashtable->slab_size *
+                                                  sizeof(hashnode_t));
+            if (slab == NULL)
+                return NULL;
+            slab->size = hashtable->slab_size;
+            slab->next = hashtable->slabs;
+            hashtable->slabs = slab;
+            hashtable->slab_used = 0;
         }
+        node = &hashtable->slabs->nodes[hashtable->slab_used++];
     }
 
-    free(hashtable->table);
-    free(hashtable);
+    node->key = key;
+    node->value = value;
+    node->hash = hash;
+    node->next = next;
 
-    return;
+    return node;
 }
 
+/*
+ * Releases one node, to the node pool of the table if it has one. You should
+ * free key and value, if needed, before calling this function.
+ */
+static void hashtable_node_delete(hashtable_t *hashtable, hashnode_t *node) {
 
-/**** CALCULATE HASH VALUE FUNCTIONS ******************************************/
+    if (hashtable->slab_size == 0) {
+        hashtable_free(hashtable, node, sizeof(hashnode_t));
+        return;
+    }
+
+    node->next = hashtable->free_nodes;
+    hashtable->free_nodes = node;
+}
 
 /*
- * Calculates the hash value of a string using djb2 algorithm by Dan Bernstein.
- * Return: Hash value of string, if parameter "string" is NULL it returns 0.
+ * Frees all slabs of the node pool of a table.
  */
-unsigned long string_hash_value(void *string) {
+static void hashtable_pool_delete(hashtable_t *hashtable) {
 
-    unsigned long hash = 5381;
-    int c;
+    hashslab_t *slab = NULL;
 
-    if (string == NULL)
-        return 0;
+    while (hashtable->slabs != NULL) {
+        slab = hashtable->slabs;
+        hashtable->slabs = slab->next;
+        hashtable_free(hashtable, slab,
+                       sizeof(hashslab_t) + slab->size * sizeof(hashnode_t));
+    }
 
-    while ((c = *((char*)string++)))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    hashtable->free_nodes = NULL;
+    hashtable->slab_used = 0;
+}
 
-    return hash;
+/*
+ * Makes every node of the pool of a table available again, keeping its slabs.
+ * No node can be in use.
+ */
+static void hashtable_pool_reset(hashtable_t *hashtable) {
+
+    hashslab_t *slab = NULL;
+    unsigned long i;
+
+    hashtable->free_nodes = NULL;
+    hashtable->slab_used = 0;
+
+    if (hashtable->slabs == NULL)
+        return;
+
+    // The newest slab is used from its start, the others through the free list
+    for (slab = hashtable->slabs->next; slab != NULL; slab = slab->next) {
+        for (i = 0; i < slab->size; i++) {
+            slab->nodes[i].next = hashtable->free_nodes;
+            hashtable->free_nodes = &slab->nodes[i];
+        }
+    }
+}
+
+/*
+ * Moves the slabs of the node pool of "source" to the pool of a table, so
+ * the nodes of "source" can be linked into the table and released to its
+ * pool. Both tables must have a node pool and the same allocator.
+ */
+static void hashtable_pool_adopt(hashtable_t *hashtable, hashtable_t *source) {
+
+    hashslab_t *slab = NULL;
+    hashnode_t *node = NULL;
+    unsigned long i;
+
+    if (source->slabs == NULL)
+        return;
+
+    // The newest slab of the table stays the one nodes are taken from
+    if (hashtable->slabs == NULL) {
+        hashtable->slabs = source->slabs;
+        hashtable->slab_used = source->slab_used;
+    }
+    else {
+        for (i = source->slab_used; i < source->slabs->size; i++) {
+            source->slabs->nodes[i].next = hashtable->free_nodes;
+            hashtable->free_nodes = &source->slabs->nodes[i];
+        }
+        for (slab = source->slabs; slab->next != NULL; slab = slab->next)
+            ;
+        slab->next = hashtable->slabs->next;
+        hashtable->slabs->next = source->slabs;
+    }
+
+    while ((node = source->free_nodes) != NULL) {
+        source->free_nodes = node->next;
+        node->next = hashtable->free_nodes;
+        hashtable->free_nodes = node;
+    }
+
+    source->slabs = NULL;
+    source->slab_used = 0;
+}
+
+
+/**** ARENA FUNCTIONS *********************************************************/
+
+/*
+ * Return: Length of a C string including its terminating null character.
+ */
+static size_t hashtable_string_length(void *string) {
+
+    return strlen((char *) string) + 1;
+}
+
+/*
+ * Copies "length" bytes into the arena of a table.
+ * Return: Pointer to the copy, NULL if an error ocurred.
+ */
+static void *hashtable_arena_copy(hashtable_t *hashtable, const void *data,
+                                  size_t length) {
+
+    hasharena_t *chunk = NULL;
+    unsigned char *copy = NULL;
+    size_t needed = (sizeof(uint64_t) + length + 7) / 8 * 8;
+    size_t size;
+
+    if (needed < length)
+        return NULL;
+
+    if (hashtable->arena == NULL ||
+        hashtable->arena->size - hashtable->arena_used < needed) {
+        size = hashtable->arena == NULL ? HASHTABLE_ARENA_MIN_CHUNK
+                                        : hashtable->arena->size * 2;
+        if (size > HASHTABLE_ARENA_MAX_CHUNK)
+            size = HASHTABLE_ARENA_MAX_CHUNK;
+        if (size < needed)
+            size = needed;
+
+        chunk = (hasharena_t *) hashtable_alloc(hashtable,
+                                                sizeof(hasharena_t) + size);
+        if (chunk == NULL)
+            return NULL;
+        chunk->next = hashtable->arena;
+        chunk->size = size;
+        hashtable->arena = chunk;
+        hashtable->arena_used = 0;
+        hashtable->arena_bytes += sizeof(hasharena_t) + size;
+    }
+
+    copy = hashtable->arena->data + hashtable->arena_used;
+    hashtable->arena_used += needed;
+
+    *(uint64_t *) copy = length;
+    memcpy(copy + sizeof(uint64_t), data, length);
+
+    return copy + sizeof(uint64_t);
+}
+
+/*
+ * Return: Length of a copy made by hashtable_arena_copy().
+ */
+static size_t hashtable_arena_length(const void *copy) {
+
+    return (size_t) ((const uint64_t *) copy)[-1];
+}
+
+/*
+ * Frees all chunks of the arena of a table.
+ */
+static void hashtable_arena_delete(hashtable_t *hashtable) {
+
+    hasharena_t *chunk = NULL;
+
+    while (hashtable->arena != NULL) {
+        chunk = hashtable->arena;
+        hashtable->arena = chunk->next;
+        hashtable_free(hashtable, chunk, sizeof(hasharena_t) + chunk->size);
+    }
+
+    hashtable->arena_used = 0;
+    hashtable->arena_bytes = 0;
+}
+
+/*
+ * Empties the arena of a table, keeping only its newest (largest) chunk.
+ * No copy can be in use.
+ */
+static void hashtable_arena_reset(hashtable_t *hashtable) {
+
+    hasharena_t *chunk = NULL;
+
+    if (hashtable->arena == NULL)
+        return;
+
+    while (hashtable->arena->next != NULL) {
+        chunk = hashtable->arena->next;
+        hashtable->arena->next = chunk->next;
+        hashtable->arena_bytes -= sizeof(hasharena_t) + chunk->size;
+        hashtable_free(hashtable, chunk, sizeof(hasharena_t) + chunk->size);
+    }
+
+    hashtable->arena_used = 0;
+}
+
+/*
+ * Moves the chunks of the arena of "source" to the arena of a table, so the
+ * copies made by "source" live as long as the table. Both tables must have
+ * the same allocator.
+ */
+static void hashtable_arena_adopt(hashtable_t *hashtable,
+                                  hashtable_t *source) {
+
+    hasharena_t *chunk = NULL;
+
+    if (source->arena == NULL)
+        return;
+
+    // The newest chunk of the table stays the one copies are made in
+    if (hashtable->arena == NULL) {
+        hashtable->arena = source->arena;
+        hashtable->arena_used = source->arena_used;
+    }
+    else {
+        for (chunk = source->arena; chunk->next != NULL; chunk = chunk->next)
+            ;
+        chunk->next = hashtable->arena->next;
+        hashtable->arena->next = source->arena;
+    }
+
+    hashtable->arena_bytes += source->arena_bytes;
+    source->arena = NULL;
+    source->arena_used = 0;
+    source->arena_bytes = 0;
+}
+
+/*
+ * Return: Length of a key searched in a table with interned keys, 0 in other
+ * tables (where it is not used).
+ */
+static size_t hashtable_key_length(hashtable_t *hashtable, void *key) {
+
+    return hashtable->intern_keys ? hashtable->key_length(key) : 0;
+}
+
+/*
+ * Compares a key searched ("length" bytes, see hashtable_key_length()) with
+ * a key of the table.
+ * Return: 1 if equal, 0 if not.
+ */
+static int hashtable_key_equal(hashtable_t *hashtable, void *key,
+                               size_t length, void *stored) {
+
+    if (hashtable->intern_keys)
+        return hashtable_arena_length(stored) == length &&
+               memcmp(key, stored, length) == 0;
+
+    return hashtable->compare(key, stored) == 0;
+}
+
+
+/**** WORKER FUNCTIONS ********************************************************/
+
+/*
+ * Runs "function" on "count" threads, the calling thread being one of them.
+ * Thread i receives the element i of "args", an array of elements of
+ * "arg_size" bytes. If a thread cannot be created its work is done by the
+ * calling thread, so all the work is always done.
+ */
+static void hashtable_run_workers(void *(*function)(void *), void *args,
+                                  size_t arg_size, unsigned int count) {
+
+    pthread_t threads[HASHTABLE_MAX_THREADS];
+    int started[HASHTABLE_MAX_THREADS];
+    unsigned int i;
+
+    if (count > HASHTABLE_MAX_THREADS)
+        count = HASHTABLE_MAX_THREADS;
+
+    for (i = 1; i < count; i++)
+        started[i] = pthread_create(&threads[i], NULL, function,
+                                    (char *) args + i * arg_size) == 0;
+
+    function(args);
+
+    for (i = 1; i < count; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            function((char *) args + i * arg_size);
+    }
+}
+
+
+/**** COUNTER FUNCTIONS *******************************************************/
+
+/*
+ * Reads a value with a relaxed atomic load. Values of integer tables can be
+ * updated by hashtable_incr_shared_hashed() while other threads read them
+ * under the same shared lock.
+ * Return: Value stored at "slot".
+ */
+static void *hashtable_load_value(void **slot) {
+
+    return (void *) atomic_load_explicit((_Atomic intptr_t *) slot,
+                                         memory_order_relaxed);
+}
+
+/*
+ * Adds a lookup that visited "probes" nodes (or groups of slots) to the
+ * counters of a table. Readers of a concurrent table share a read lock, so
+ * counters use relaxed loads and stores instead of atomic additions: they cost
+ * as much as plain increments, but increments of threads racing on the same
+ * table may be lost.
+ */
+static void hashtable_count_lookup(hashtable_t *hashtable, int hit,
+                                   unsigned long probes) {
+
+    atomic_ulong *result = hit ? &hashtable->hits : &hashtable->misses;
+
+    atomic_store_explicit(&hashtable->lookups,
+        atomic_load_explicit(&hashtable->lookups, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+    atomic_store_explicit(result,
+        atomic_load_explicit(result, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+    atomic_store_explicit(&hashtable->probes,
+        atomic_load_explicit(&hashtable->probes, memory_order_relaxed) + probes,
+        memory_order_relaxed);
+}
+
+/*
+ * Sets the counters of a table to 0.
+ */
+static void hashtable_reset_counters(hashtable_t *hashtable) {
+
+    atomic_store_explicit(&hashtable->lookups, 0, memory_order_relaxed);
+    atomic_store_explicit(&hashtable->hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&hashtable->misses, 0, memory_order_relaxed);
+    atomic_store_explicit(&hashtable->probes, 0, memory_order_relaxed);
+}
+
+
+/**** TIMER WHEEL FUNCTIONS ***************************************************/
+
+/*
+ * Return: Milliseconds of the monotonic clock.
+ */
+static uint64_t hashtable_now_ms(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+/*
+ * Links "slot" in the list of the timing wheel where its expiration falls:
+ * the lowest level whose lists span past it, and in that level the list of
+ * its millisecond (shifted to the level).
+ */
+static void hashtable_timer_link(hashtable_t *hashtable, unsigned long slot) {
+
+    hashwheel_t *wheel = hashtable->wheel;
+    uint64_t expires = hashtable->expires[slot];
+    uint64_t delta;
+    unsigned long list;
+    unsigned int level;
+
+    // Overdue keys go to the next list processed
+    if (expires < wheel->tick)
+        expires = wheel->tick;
+    delta = expires - wheel->tick;
+
+    for (level = 0; level < HASHTABLE_WHEEL_LEVELS - 1; level++)
+        if ((delta >> (HASHTABLE_WHEEL_BITS * (level + 1))) == 0)
+            break;
+
+    // Beyond the top level: wait in its furthest list and link again later
+    if ((delta >> (HASHTABLE_WHEEL_BITS * HASHTABLE_WHEEL_LEVELS)) != 0)
+        expires = wheel->tick +
+                  ((uint64_t) 1 << (HASHTABLE_WHEEL_BITS *
+                                    HASHTABLE_WHEEL_LEVELS)) - 1;
+
+    list = level * HASHTABLE_WHEEL_SLOTS +
+           ((expires >> (HASHTABLE_WHEEL_BITS * level)) &
+            (HASHTABLE_WHEEL_SLOTS - 1));
+
+    hashtable->timer_next[slot] = wheel->lists[list];
+    hashtable->timer_prev[slot] = hashtable->size + list;
+    if (wheel->lists[list] != HASHTABLE_TIMER_NONE)
+        hashtable->timer_prev[wheel->lists[list]] = slot;
+    wheel->lists[list] = slot;
+    wheel->timers++;
+}
+
+/*
+ * Removes "slot" from its list of the timing wheel.
+ */
+static void hashtable_timer_unlink(hashtable_t *hashtable,
+                                   unsigned long slot) {
+
+    unsigned long next = hashtable->timer_next[slot];
+    unsigned long prev = hashtable->timer_prev[slot];
+
+    if (prev >= hashtable->size)
+        hashtable->wheel->lists[prev - hashtable->size] = next;
+    else
+        hashtable->timer_next[prev] = next;
+
+    if (next != HASHTABLE_TIMER_NONE)
+        hashtable->timer_prev[next] = prev;
+
+    hashtable->wheel->timers--;
+}
+
+/*
+ * Empties all lists of the timing wheel.
+ */
+static void hashtable_wheel_reset(hashtable_t *hashtable) {
+
+    unsigned long i;
+
+    for (i = 0; i < HASHTABLE_WHEEL_LEVELS * HASHTABLE_WHEEL_SLOTS; i++)
+        hashtable->wheel->lists[i] = HASHTABLE_TIMER_NONE;
+
+    hashtable->wheel->timers = 0;
+}
+
+/*
+ * Moves the keys of a list of the timing wheel to the lists where they
+ * belong now, at most "*work" of them.
+ * Return: 0 if the list was emptied, -1 if "*work" ran out.
+ */
+static int hashtable_wheel_cascade(hashtable_t *hashtable,
+                                   unsigned long list, unsigned long *work) {
+
+    unsigned long slot;
+
+    while ((slot = hashtable->wheel->lists[list]) != HASHTABLE_TIMER_NONE) {
+        if (*work == 0)
+            return -1;
+        (*work)--;
+
+        hashtable_timer_unlink(hashtable, slot);
+        hashtable_timer_link(hashtable, slot);
+
+        // Keys expiring past the top level can come back to the same list
+        if (hashtable->wheel->lists[list] == slot)
+            break;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Finds the next millisecond after "tick" at which the timing wheel has work:
+ * a list of level 0 with keys, or a list of an upper level with keys to move
+ * down. The list of level 0 of "tick" must be empty and the lists of upper
+ * levels starting at "tick" already moved down.
+ * Return: Next millisecond to process, in at most
+ * HASHTABLE_WHEEL_SLOTS ^ HASHTABLE_WHEEL_LEVELS milliseconds.
+ */
+static uint64_t hashtable_wheel_next(hashtable_t *hashtable, uint64_t tick) {
+
+    const unsigned long *lists = hashtable->wheel->lists;
+    uint64_t next = UINT64_MAX;
+    uint64_t base;
+    uint64_t at;
+    unsigned long current;
+    unsigned long i;
+    unsigned int level;
+    unsigned int shift;
+
+    for (level = 0; level < HASHTABLE_WHEEL_LEVELS; level++) {
+        shift = HASHTABLE_WHEEL_BITS * level;
+        base = tick >> shift;
+        current = base & (HASHTABLE_WHEEL_SLOTS - 1);
+
+        // Lists up to the current one are in the next turn of the level
+        for (i = 0; i < HASHTABLE_WHEEL_SLOTS; i++) {
+            if (lists[level * HASHTABLE_WHEEL_SLOTS + i] ==
+                HASHTABLE_TIMER_NONE)
+                continue;
+            at = base - current + i;
+            if (i <= current)
+                at += HASHTABLE_WHEEL_SLOTS;
+            at <<= shift;
+            if (at < next)
+                next = at;
+        }
+    }
+
+    return next;
+}
+
+
+/**** OPEN ADDRESSING FUNCTIONS ***********************************************/
+
+/*
+ * Return: Bytes of the allocation of "ctrl" of an open addressing table of
+ * "size" slots: control bytes, slots and the arrays of caches and tables
+ * with a time to live.
+ */
+static size_t hashtable_oa_bytes(hashtable_t *hashtable, unsigned long size) {
+
+    size_t slot_bytes = 1 + sizeof(hashslot_t);
+
+    if (hashtable->max_bytes > 0)
+        slot_bytes += sizeof(size_t);
+    if (hashtable->wheel != NULL)
+        slot_bytes += sizeof(uint64_t) + 2 * sizeof(unsigned long);
+    if (hashtable->max_entries > 0 || hashtable->max_bytes > 0)
+        slot_bytes += 1;
+
+    return size * slot_bytes;
+}
+
+/*
+ * Allocates the control bytes and slots of an open addressing table with
+ * "size" slots (a power of two multiple of HASHTABLE_GROUP_WIDTH). Control
+ * bytes and slots share one allocation, control bytes first, followed by the
+ * charges and reference bytes of a cache.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_oa_alloc(hashtable_t *hashtable, unsigned long size) {
+
+    signed char *ctrl = NULL;
+    unsigned char *next = NULL;
+    int cache = hashtable->max_entries > 0 || hashtable->max_bytes > 0;
+    int ttl = hashtable->wheel != NULL;
+    unsigned long i;
+
+    ctrl = (signed char *) hashtable_alloc(hashtable,
+                                           hashtable_oa_bytes(hashtable,
+                                                              size));
+    if (ctrl == NULL)
+        return -1;
+
+    for (i = 0; i < size; i++)
+        ctrl[i] = HASHTABLE_CTRL_EMPTY;
+
+    hashtable->ctrl = ctrl;
+    hashtable->slots = (hashslot_t *) (ctrl + size);
+    hashtable->charges = NULL;
+    hashtable->expires = NULL;
+    hashtable->timer_next = NULL;
+    hashtable->timer_prev = NULL;
+    hashtable->referenced = NULL;
+
+    // Arrays of 8 byte elements first, all aligned after the slots
+    next = (unsigned char *) (hashtable->slots + size);
+    if (hashtable->max_bytes > 0) {
+        hashtable->charges = (size_t *) next;
+        next += size * sizeof(size_t);
+    }
+    if (ttl) {
+        hashtable->expires = (uint64_t *) next;
+        next += size * sizeof(uint64_t);
+        hashtable->timer_next = (unsigned long *) next;
+        next += size * sizeof(unsigned long);
+        hashtable->timer_prev = (unsigned long *) next;
+        next += size * sizeof(unsigned long);
+    }
+    if (cache)
+        hashtable->referenced = next;
+    hashtable->size = size;
+    hashtable->tombstones = 0;
+    hashtable->hand = 0;
+
+    return 0;
+}
+
+/*
+ * Rounds a number of slots up to a valid open addressing table size.
+ * Return: Calculated size.
+ */
+static unsigned long hashtable_oa_round_size(unsigned long size) {
+
+    if (size < HASHTABLE_GROUP_WIDTH)
+        return HASHTABLE_GROUP_WIDTH;
+
+    return hashtable_round_pow2(size);
+}
+
+/*
+ * Return: Maximum number of used slots (keys and tombstones) of an open
+ * addressing table of "size" slots.
+ */
+static unsigned long hashtable_oa_limit(hashtable_t *hashtable,
+                                        unsigned long size) {
+
+    unsigned long limit = size / 8 * HASHTABLE_OA_MAX_LOAD_EIGHTHS;
+
+    if (hashtable->max_load_factor > 0 &&
+        size * hashtable->max_load_factor < limit)
+        limit = size * hashtable->max_load_factor;
+
+    return limit;
+}
+
+/*
+ * Finds the slot of a key. If "groups" is not NULL it receives the number of
+ * groups visited.
+ * Return: Slot index, or the number of slots if the key is not in the table.
+ */
+static unsigned long hashtable_oa_find(hashtable_t *hashtable, void *key,
+                                       unsigned long hash,
+                                       unsigned long *groups) {
+
+    uint64_t mixed = hashtable_mix(hash);
+    signed char h2 = hashgroup_h2(mixed);
+    hashprobe_t probe;
+    unsigned long slot;
+    unsigned int mask;
+    const signed char *ctrl;
+    size_t length = hashtable_key_length(hashtable, key);
+
+    hashprobe_start(&probe, mixed, hashtable->size);
+    do {
+        ctrl = hashtable->ctrl + probe.offset;
+
+        for (mask = hashgroup_match(ctrl, h2); mask != 0; mask &= mask - 1) {
+            slot = probe.offset + hashgroup_first(mask);
+            if (hashtable_key_equal(hashtable, key, length,
+                                    hashtable->slots[slot].key)) {
+                if (groups != NULL)
+                    *groups = probe.step + 1;
+                return slot;
+            }
+        }
+
+        if (hashgroup_match(ctrl, HASHTABLE_CTRL_EMPTY) != 0)
+            break;
+    } while (hashprobe_next(&probe));
+
+    if (groups != NULL)
+        *groups = probe.step <= probe.groups_mask ? probe.step + 1
+                                                  : probe.step;
+    return hashtable->size;
+}
+
+/*
+ * Finds a free slot for a key that is not in the table and marks it as used.
+ * The table must have at least one free slot.
+ * Return: Slot index.
+ */
+static unsigned long hashtable_oa_claim(hashtable_t *hashtable,
+                                        unsigned long hash) {
+
+    return hashgroup_claim(hashtable->ctrl, hashtable->size,
+                           hashtable_mix(hash), &hashtable->tombstones);
+}
+
+/*
+ * Moves all keys to a new array of "size" slots. Also used with the current
+ * size to remove tombstones.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_oa_resize(hashtable_t *hashtable, unsigned long size) {
+
+    signed char *old_ctrl = hashtable->ctrl;
+    hashslot_t *old_slots = hashtable->slots;
+    unsigned char *old_referenced = hashtable->referenced;
+    size_t *old_charges = hashtable->charges;
+    uint64_t *old_expires = hashtable->expires;
+    unsigned long *old_timer_next = hashtable->timer_next;
+    unsigned long *old_timer_prev = hashtable->timer_prev;
+    unsigned long old_size = hashtable->size;
+    unsigned long old_tombstones = hashtable->tombstones;
+    unsigned long old_hand = hashtable->hand;
+    unsigned long slot;
+    unsigned long i;
+
+    if (hashtable_oa_alloc(hashtable, size) != 0) {
+        hashtable->ctrl = old_ctrl;
+        hashtable->slots = old_slots;
+        hashtable->referenced = old_referenced;
+        hashtable->charges = old_charges;
+        hashtable->expires = old_expires;
+        hashtable->timer_next = old_timer_next;
+        hashtable->timer_prev = old_timer_prev;
+        hashtable->size = old_size;
+        hashtable->tombstones = old_tombstones;
+        hashtable->hand = old_hand;
+        return -1;
+    }
+
+    for (i = 0; i < old_size; i++) {
+        if (old_ctrl[i] < 0)
+            continue;
+        slot = hashtable_oa_claim(hashtable,
+                                  hashtable_hash_key(hashtable,
+                                                     old_slots[i].key));
+        hashtable->slots[slot] = old_slots[i];
+        if (old_referenced != NULL)
+            hashtable->referenced[slot] = old_referenced[i];
+        if (old_charges != NULL)
+            hashtable->charges[slot] = old_charges[i];
+        if (old_expires != NULL)
+            hashtable->expires[slot] = old_expires[i];
+    }
+
+    // Slots changed, the timing wheel is linked again
+    if (hashtable->wheel != NULL) {
+        hashtable_wheel_reset(hashtable);
+        for (i = 0; i < size; i++)
+            if (hashtable->ctrl[i] >= 0 && hashtable->expires[i] != 0)
+                hashtable_timer_link(hashtable, i);
+    }
+
+    hashtable_free(hashtable, old_ctrl,
+                   hashtable_oa_bytes(hashtable, old_size));
+    return 0;
+}
+
+/*
+ * Marks a used slot as free. Its key and value must be already freed.
+ */
+static void hashtable_oa_erase(hashtable_t *hashtable, unsigned long slot) {
+
+    hashgroup_erase(hashtable->ctrl, slot, &hashtable->tombstones);
+    hashtable->count--;
+
+    if (hashtable->charges != NULL)
+        hashtable->bytes -= hashtable->charges[slot];
+    if (hashtable->expires != NULL && hashtable->expires[slot] != 0)
+        hashtable_timer_unlink(hashtable, slot);
+}
+
+/*
+ * Evicts one key of a cache with the CLOCK algorithm: the hand goes around
+ * the slots clearing reference bytes, and the first used slot whose byte is
+ * already clear loses its key. The key and value go to the eviction function
+ * if the table has one, or else to the delete functions. Every key is passed
+ * over at most once, so an eviction is O(1) amortized. Slot "keep" is never
+ * evicted (the number of slots keeps none), so the cache needs another key.
+ */
+static void hashtable_evict(hashtable_t *hashtable, unsigned long keep) {
+
+    unsigned long mask = hashtable->size - 1;
+    unsigned long slot;
+
+    if (hashtable->count == 0)
+        return;
+
+    for (;;) {
+        slot = hashtable->hand;
+        hashtable->hand = (slot + 1) & mask;
+
+        if (hashtable->ctrl[slot] < 0 || slot == keep)
+            continue;
+
+        if (hashtable->referenced[slot]) {
+            hashtable->referenced[slot] = 0;
+            continue;
+        }
+
+        break;
+    }
+
+    if (hashtable->evict != NULL) {
+        hashtable->evict(hashtable->slots[slot].key,
+                         hashtable->slots[slot].value, hashtable->evict_data);
+    }
+    else {
+        if (hashtable->key_delete != NULL)
+            hashtable->key_delete(hashtable->slots[slot].key);
+        if (hashtable->value_delete != NULL)
+            hashtable->value_delete(hashtable->slots[slot].value);
+    }
+
+    hashtable_oa_erase(hashtable, slot);
+    hashtable->evictions++;
+}
+
+/*
+ * Return: Bytes charged to a cache with "max_bytes" for a key-value pair.
+ */
+static size_t hashtable_cache_charge(hashtable_t *hashtable, void *key,
+                                     void *value) {
+
+    size_t charge = sizeof(hashslot_t) + hashtable->key_length(key);
+
+    if (value != NULL)
+        charge += hashtable->value_length(value);
+
+    return charge;
+}
+
+/*
+ * Charges the current key-value pair of "slot" to a cache with "max_bytes"
+ * and evicts other keys until the cache fits in its budget, or only the
+ * slot is left.
+ */
+static void hashtable_cache_charge_slot(hashtable_t *hashtable,
+                                        unsigned long slot) {
+
+    hashtable->bytes -= hashtable->charges[slot];
+    hashtable->charges[slot] =
+        hashtable_cache_charge(hashtable, hashtable->slots[slot].key,
+                               hashtable->slots[slot].value);
+    hashtable->bytes += hashtable->charges[slot];
+
+    while (hashtable->bytes > hashtable->max_bytes && hashtable->count > 1)
+        hashtable_evict(hashtable, slot);
+}
+
+/*
+ * Return: Slot of an open addressing table that holds the value "value"
+ * points to.
+ */
+static unsigned long hashtable_oa_slot(hashtable_t *hashtable,
+                                          void **value) {
+
+    return (unsigned long) ((hashslot_t *) ((char *) value -
+                                            offsetof(hashslot_t, value)) -
+                            hashtable->slots);
+}
+
+/*
+ * Return: 1 if the key of "slot" has expired, 0 if not.
+ */
+static int hashtable_oa_expired(hashtable_t *hashtable, unsigned long slot) {
+
+    return hashtable->expires != NULL && hashtable->expires[slot] != 0 &&
+           hashtable->expires[slot] <= hashtable_now_ms();
+}
+
+/*
+ * Removes the expired key of "slot", freeing key and value with the delete
+ * functions.
+ */
+static void hashtable_oa_expire_slot(hashtable_t *hashtable,
+                                     unsigned long slot) {
+
+    if (hashtable->key_delete != NULL)
+        hashtable->key_delete(hashtable->slots[slot].key);
+    if (hashtable->value_delete != NULL)
+        hashtable->value_delete(hashtable->slots[slot].value);
+
+    hashtable_oa_erase(hashtable, slot);
+    hashtable->expirations++;
+}
+
+/*
+ * Advances the timing wheel up to millisecond "now", removing expired keys
+ * and moving keys down the levels, at most "work" of them. Milliseconds
+ * without work are skipped, also "work" times at most. The wheel stops where
+ * the work runs out and goes on in the next call.
+ * Return: Number of keys removed.
+ */
+static unsigned long hashtable_expire_run(hashtable_t *hashtable,
+                                          uint64_t now, unsigned long work) {
+
+    hashwheel_t *wheel = hashtable->wheel;
+    unsigned long empty_visits = work;
+    unsigned long expired = 0;
+    unsigned long list;
+    unsigned long slot;
+    unsigned int level;
+    uint64_t tick;
+
+    // Nothing to wait for: jump to now
+    if (wheel->timers == 0) {
+        if (wheel->tick < now)
+            wheel->tick = now;
+        return 0;
+    }
+
+    while (wheel->tick <= now) {
+        tick = wheel->tick;
+
+        // At the start of a list of an upper level its keys move down
+        for (level = HASHTABLE_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((tick & (((uint64_t) 1 << (HASHTABLE_WHEEL_BITS * level)) - 1))
+                != 0)
+                continue;
+            list = level * HASHTABLE_WHEEL_SLOTS +
+                   ((tick >> (HASHTABLE_WHEEL_BITS * level)) &
+                    (HASHTABLE_WHEEL_SLOTS - 1));
+            if (hashtable_wheel_cascade(hashtable, list, &work) != 0)
+                return expired;
+        }
+
+        list = tick & (HASHTABLE_WHEEL_SLOTS - 1);
+
+        // Skip to the next millisecond with work, or past now
+        if (wheel->lists[list] == HASHTABLE_TIMER_NONE) {
+            tick = wheel->timers > 0 ? hashtable_wheel_next(hashtable, tick)
+                                     : now + 1;
+            wheel->tick = tick < now + 1 ? tick : now + 1;
+            if (--empty_visits == 0)
+                break;
+            continue;
+        }
+
+        while ((slot = wheel->lists[list]) != HASHTABLE_TIMER_NONE) {
+            if (work == 0)
+                return expired;
+            work--;
+
+            if (hashtable->expires[slot] <= now) {
+                hashtable_oa_expire_slot(hashtable, slot);
+                expired++;
+            }
+            else {
+                // Waited in the top level for longer than the wheel spans
+                hashtable_timer_unlink(hashtable, slot);
+                hashtable_timer_link(hashtable, slot);
+            }
+        }
+
+        wheel->tick++;
+    }
+
+    return expired;
+}
+
+/*
+ * Runs an expiration step of a table with a time to live.
+ */
+static void hashtable_expire_step(hashtable_t *hashtable) {
+
+    if (hashtable->wheel != NULL)
+        hashtable_expire_run(hashtable, hashtable_now_ms(),
+                             hashtable->expire_step);
+}
+
+/*
+ * Open addressing version of hashtable_upsert_hashed().
+ * Return: NULL on error, pointer to the value of the key on success.
+ */
+static void **hashtable_oa_upsert(hashtable_t *hashtable, void *key,
+                                  unsigned long hash, int *inserted) {
+
+    unsigned long slot;
+    unsigned long size;
+
+    hashtable_expire_step(hashtable);
+    size = hashtable->size;
+
+    slot = hashtable_oa_find(hashtable, key, hash, NULL);
+    if (slot < size && hashtable_oa_expired(hashtable, slot)) {
+        hashtable_oa_expire_slot(hashtable, slot);
+        slot = size;
+    }
+    if (slot < size) {
+        if (hashtable->referenced != NULL)
+            hashtable->referenced[slot] = 1;
+        *inserted = 0;
+        return &hashtable->slots[slot].value;
+    }
+
+    // A full cache makes room instead of growing
+    if (hashtable->max_entries > 0) {
+        while (hashtable->count >= hashtable->max_entries)
+            hashtable_evict(hashtable, hashtable->size);
+        size = hashtable->size;
+    }
+
+    size = hashgroup_resize_size(size, hashtable->count,
+                                 hashtable->tombstones,
+                                 hashtable_oa_limit(hashtable, size));
+    if (size != 0 && hashtable_oa_resize(hashtable, size) != 0 &&
+        hashtable->count + hashtable->tombstones >= hashtable->size)
+        return NULL;
+
+    if (hashtable->intern_keys) {
+        key = hashtable_arena_copy(hashtable, key,
+                                   hashtable->key_length(key));
+        if (key == NULL)
+            return NULL;
+    }
+
+    slot = hashtable_oa_claim(hashtable, hash);
+    hashtable->slots[slot].key = key;
+    hashtable->slots[slot].value = NULL;
+    hashtable->count++;
+
+    if (hashtable->expires != NULL)
+        hashtable->expires[slot] = 0;
+
+    // New keys are evicted first unless they are used again
+    if (hashtable->referenced != NULL)
+        hashtable->referenced[slot] = 0;
+    if (hashtable->charges != NULL) {
+        hashtable->charges[slot] = 0;
+        hashtable_cache_charge_slot(hashtable, slot);
+    }
+
+    *inserted = 1;
+    return &hashtable->slots[slot].value;
+}
+
+/*
+ * Open addressing version of hashtable_get_hashed(). If "touch" is not 0 the
+ * key is marked as used for the eviction of a cache, and expired keys are
+ * removed (otherwise they are only not found).
+ * Return: NULL if not found, value on success.
+ */
+static void *hashtable_oa_get(hashtable_t *hashtable, void *key,
+                              unsigned long hash, int touch) {
+
+    unsigned long slot;
+    unsigned long groups;
+
+    if (touch)
+        hashtable_expire_step(hashtable);
+
+    slot = hashtable_oa_find(hashtable, key, hash, &groups);
+
+    if (slot != hashtable->size && hashtable_oa_expired(hashtable, slot)) {
+        if (touch)
+            hashtable_oa_expire_slot(hashtable, slot);
+        slot = hashtable->size;
+    }
+
+    if (hashtable->counters)
+        hashtable_count_lookup(hashtable, slot != hashtable->size, groups);
+
+    if (slot == hashtable->size)
+        return NULL;
+
+    // Written only when clear, so hot keys do not dirty their cache line
+    if (touch && hashtable->referenced != NULL &&
+        !hashtable->referenced[slot])
+        hashtable->referenced[slot] = 1;
+
+    return hashtable_load_value(&hashtable->slots[slot].value);
+}
+
+/*
+ * Open addressing version of hashtable_remove().
+ * Return: 0 on success.
+ */
+static int hashtable_oa_remove(hashtable_t *hashtable, void *key,
+                               unsigned long hash, void **value) {
+
+    unsigned long slot;
+    unsigned long size;
+
+    hashtable_expire_step(hashtable);
+
+    slot = hashtable_oa_find(hashtable, key, hash, NULL);
+    if (slot == hashtable->size)
+        return 0;
+
+    // An expired value is freed, not returned
+    if (value != NULL && hashtable_oa_expired(hashtable, slot))
+        value = NULL;
+
+    if (hashtable->key_delete != NULL)
+        hashtable->key_delete(hashtable->slots[slot].key);
+    if (value != NULL)
+        *value = hashtable->slots[slot].value;
+    else if (hashtable->value_delete != NULL)
+        hashtable->value_delete(hashtable->slots[slot].value);
+
+    hashtable_oa_erase(hashtable, slot);
+
+    size = hashtable->size;
+    if (hashtable->min_load_factor > 0 && size / 2 >= hashtable->min_size &&
+        hashtable->count < size * hashtable->min_load_factor &&
+        hashtable->iterators == 0)
+        hashtable_oa_resize(hashtable, size / 2);
+
+    return 0;
+}
+
+/*
+ * Removes all keys of an open addressing table, keeping its slots.
+ */
+static void hashtable_oa_clear(hashtable_t *hashtable) {
+
+    unsigned long i;
+
+    if (hashtable->key_delete != NULL || hashtable->value_delete != NULL) {
+        for (i = 0; i < hashtable->size; i++) {
+            if (hashtable->ctrl[i] < 0)
+                continue;
+            if (hashtable->key_delete != NULL)
+                hashtable->key_delete(hashtable->slots[i].key);
+            if (hashtable->value_delete != NULL)
+                hashtable->value_delete(hashtable->slots[i].value);
+        }
+    }
+
+    memset(hashtable->ctrl, (unsigned char) HASHTABLE_CTRL_EMPTY,
+           hashtable->size);
+    hashtable->count = 0;
+    hashtable->tombstones = 0;
+    hashtable->bytes = 0;
+    hashtable->hand = 0;
+    if (hashtable->wheel != NULL)
+        hashtable_wheel_reset(hashtable);
+}
+
+/*
+ * Frees all slots of an open addressing table.
+ */
+static void hashtable_oa_delete(hashtable_t *hashtable) {
+
+    hashtable_oa_clear(hashtable);
+    hashtable_free(hashtable, hashtable->ctrl,
+                   hashtable_oa_bytes(hashtable, hashtable->size));
+    hashtable_free(hashtable, hashtable->wheel, sizeof(hashwheel_t));
+}
+
+
+/**** MAPPED TABLE FUNCTIONS **************************************************/
+
+/*
+ * Finds the entry at "offset" of the snapshot mapped by a table, checking
+ * that it is inside the file.
+ * Return: Entry, or NULL if the offset is 0 or not valid.
+ */
+static hashsnapshot_entry_t *hashtable_mapped_entry(hashtable_t *hashtable,
+                                                    uint64_t offset) {
+
+    hashsnapshot_entry_t *entry = NULL;
+    uint64_t available;
+
+    if (offset == 0 || offset % 8 != 0 ||
+        offset > hashtable->map_size - sizeof(hashsnapshot_entry_t))
+        return NULL;
+
+    // Key (padded to 8 bytes) and value must end inside the file
+    entry = (hashsnapshot_entry_t *) (hashtable->map + offset);
+    available = hashtable->map_size - offset - sizeof(hashsnapshot_entry_t);
+    if (entry->key_length > available ||
+        (entry->key_length + 7) / 8 * 8 > available)
+        return NULL;
+
+    available -= (entry->key_length + 7) / 8 * 8;
+    if (entry->value_length != HASHSNAPSHOT_NULL_VALUE &&
+        entry->value_length > available)
+        return NULL;
+
+    return entry;
+}
+
+/*
+ * Return: Key bytes of an entry.
+ */
+static void *hashtable_mapped_key(hashsnapshot_entry_t *entry) {
+
+    return (unsigned char *) entry + sizeof(hashsnapshot_entry_t);
+}
+
+/*
+ * Return: Value bytes of an entry, NULL if the value was NULL.
+ */
+static void *hashtable_mapped_value(hashsnapshot_entry_t *entry) {
+
+    if (entry->value_length == HASHSNAPSHOT_NULL_VALUE)
+        return NULL;
+
+    return (unsigned char *) entry + sizeof(hashsnapshot_entry_t) +
+           (entry->key_length + 7) / 8 * 8;
+}
+
+/*
+ * Return: First entry of bucket "position" of a mapped table, NULL if empty.
+ */
+static hashsnapshot_entry_t *hashtable_mapped_bucket(hashtable_t *hashtable,
+                                                     unsigned long position) {
+
+    const uint64_t *buckets;
+
+    buckets = (const uint64_t *) (hashtable->map +
+                  ((hashsnapshot_header_t *) hashtable->map)->buckets);
+
+    return hashtable_mapped_entry(hashtable, buckets[position]);
+}
+
+/*
+ * Mapped table version of hashtable_get_hashed().
+ * Return: NULL if not found, value (inside the mapped file) on success.
+ */
+static void *hashtable_mapped_get(hashtable_t *hashtable, void *key,
+                                  unsigned long hash) {
+
+    hashsnapshot_entry_t *entry = NULL;
+    unsigned long position;
+    unsigned long probes = 0;
+
+    position = hashtable_calculate_key_position(hashtable, hash,
+                                                hashtable->size);
+
+    for (entry = hashtable_mapped_bucket(hashtable, position); entry != NULL;
+         entry = hashtable_mapped_entry(hashtable, entry->next)) {
+        probes++;
+        if ((unsigned long) entry->hash == hash &&
+            hashtable->compare(key, hashtable_mapped_key(entry)) == 0)
+            break;
+    }
+
+    if (hashtable->counters)
+        hashtable_count_lookup(hashtable, entry != NULL, probes);
+
+    return entry != NULL ? hashtable_mapped_value(entry) : NULL;
+}
+
+
+/**** HASHTABLE FUNCTIONS *****************************************************/
+
+/*
+ * Fills "options" with the default values used by hashtable_create().
+ */
+void hashtable_options_init(hashtable_options_t *options) {
+
+    if (options == NULL)
+        return;
+
+    options->max_load_factor = HASHTABLE_DEFAULT_MAX_LOAD_FACTOR;
+    options->min_load_factor = HASHTABLE_DEFAULT_MIN_LOAD_FACTOR;
+    options->rehash_step = HASHTABLE_DEFAULT_REHASH_STEP;
+    options->backend = HASHTABLE_BACKEND_CHAINED;
+    options->node_pool_slab_size = 0;
+    options->exact_size = 0;
+    options->hashvalue_seeded = NULL;
+    options->seed = 0;
+    options->threads = 1;
+    options->counters = 0;
+    options->intern_keys = 0;
+    options->key_length = NULL;
+    options->intern_values = 0;
+    options->value_length = NULL;
+    options->max_entries = 0;
+    options->max_bytes = 0;
+    options->evict = NULL;
+    options->evict_data = NULL;
+    options->ttl = 0;
+    options->expire_step = HASHTABLE_DEFAULT_EXPIRE_STEP;
+}
+
+/*
+ * Creates a new hash table.
+ * Parameter "size" must be greater than 0, it is rounded up to a power of two.
+ * Parameter "compare_function" cannot be NULL, is needed to compare keys.
+ * Parameter "hashvalue_function" cannot be NULL, is needed to calculate key
+ * position in the hash table.
+ * Parameter "key_delete_function" is used to free allocated memory for a key,
+ * this paremeter can be NULL if no memory was allocated with malloc or similar.
+ * Parameter "value_delete_function" is used to free allocated memory for a
+ * value, this paremeter can be NULL if no memory was allocated with malloc or
+ * similar.
+ * Return: NULL if error, pointer to hashtable on success.
+ */
+ hashtable_t *hashtable_create(unsigned long size,
+                               fp_compare_keys compare_function,
+                               fp_hashvalue hashvalue_function,
+                               fp_delete key_delete_function,
+                               fp_delete value_delete_function) {
+
+    return hashtable_create_with_options(size, compare_function,
+                                         hashvalue_function,
+                                         key_delete_function,
+                                         value_delete_function, NULL);
+}
+
+/*
+ * Same as hashtable_create(), but with the behaviour described in "options".
+ * Parameter "options" can be NULL to use the default options.
+ * Return: NULL if error, pointer to hashtable on success.
+ */
+hashtable_t *hashtable_create_with_options(unsigned long size,
+                                           fp_compare_keys compare_function,
+                                           fp_hashvalue hashvalue_function,
+                                           fp_delete key_delete_function,
+                                           fp_delete value_delete_function,
+                                           const hashtable_options_t *options) {
+
+    return hashtable_create_with_allocator(size, compare_function,
+                                           hashvalue_function,
+                                           key_delete_function,
+                                           value_delete_function, options,
+                                           NULL);
+}
+
+/*
+ * Same as hashtable_create_with_options(), with all memory of the table
+ * coming from "allocator".
+ * Parameter "allocator" can be NULL to use malloc.
+ * Return: NULL if error, pointer to hashtable on success.
+ */
+hashtable_t *hashtable_create_with_allocator(unsigned long size,
+                                    fp_compare_keys compare_function,
+                                    fp_hashvalue hashvalue_function,
+                                    fp_delete key_delete_function,
+                                    fp_delete value_delete_function,
+                                    const hashtable_options_t *options,
+                                    const hashtable_allocator_t *allocator) {
+
+    hashtable_t *hashtable = NULL;
+    hashtable_options_t defaults;
+
+    if (allocator == NULL)
+        allocator = &hashtable_default_allocator;
+
+    if (allocator->alloc == NULL || allocator->free == NULL ||
+        allocator->realloc == NULL)
+        return NULL;
+
+    if (options == NULL) {
+        hashtable_options_init(&defaults);
+        options = &defaults;
+    }
+
+    if (size < 1 || (compare_function == NULL && !options->intern_keys) ||
+        (hashvalue_function == NULL && options->hashvalue_seeded == NULL))
+        return NULL;
+
+    if (options->max_load_factor < 0 || options->min_load_factor < 0)
+        return NULL;
+
+    if (options->backend != HASHTABLE_BACKEND_CHAINED &&
+        options->backend != HASHTABLE_BACKEND_OPEN_ADDRESSING)
+        return NULL;
+
+    // Evicted keys would leave their copies in the arena
+    if ((options->max_entries > 0 || options->max_bytes > 0) &&
+        (options->intern_keys || options->intern_values))
+        return NULL;
+
+    // Shrinking must leave the table below the growth threshold
+    if (options->min_load_factor > 0 &&
+        (options->max_load_factor == 0 ||
+         options->min_load_factor * 2 > options->max_load_factor))
+        return NULL;
+
+    hashtable = (hashtable_t *) allocator->alloc(sizeof(hashtable_t),
+                                                 allocator->context);
+    if (hashtable == NULL)
+        return NULL;
+
+    hashtable->allocator = *allocator;
+    hashtable->backend = options->backend;
+    hashtable->size = size;
+    hashtable->count = 0;
+    hashtable->table = NULL;
+    hashtable->ctrl = NULL;
+    hashtable->slots = NULL;
+    hashtable->map = NULL;
+    hashtable->map_size = 0;
+    hashtable->tombstones = 0;
+    hashtable->iterators = 0;
+    hashtable->iterator_list = NULL;
+    hashtable->counters = options->counters;
+    hashtable_reset_counters(hashtable);
+    hashtable->slab_size = options->node_pool_slab_size;
+    hashtable->slab_used = 0;
+    hashtable->slabs = NULL;
+    hashtable->free_nodes = NULL;
+    hashtable->referenced = NULL;
+    hashtable->charges = NULL;
+    hashtable->hand = 0;
+    hashtable->max_entries = options->max_entries;
+    hashtable->max_bytes = options->max_bytes;
+    hashtable->bytes = 0;
+    hashtable->evictions = 0;
+    hashtable->evict = options->evict;
+    hashtable->evict_data = options->evict_data;
+    hashtable->expires = NULL;
+    hashtable->timer_next = NULL;
+    hashtable->timer_prev = NULL;
+    hashtable->wheel = NULL;
+    hashtable->expire_step = options->expire_step > 0 ? options->expire_step
+                                                      : 1;
+    hashtable->expirations = 0;
+
+    // Caches and keys with a time to live need the slots of open addressing
+    if (hashtable->max_entries > 0 || hashtable->max_bytes > 0 ||
+        options->ttl)
+        hashtable->backend = HASHTABLE_BACKEND_OPEN_ADDRESSING;
+
+    if (options->ttl) {
+        hashtable->wheel = (hashwheel_t *) hashtable_alloc(hashtable,
+                                                           sizeof(hashwheel_t));
+        if (hashtable->wheel == NULL) {
+            hashtable_free(hashtable, hashtable, sizeof(hashtable_t));
+            return NULL;
+        }
+        hashtable->wheel->tick = hashtable_now_ms();
+        hashtable_wheel_reset(hashtable);
+    }
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        size = hashtable_oa_round_size(size);
+        if (hashtable_oa_alloc(hashtable, size) != 0) {
+            hashtable_free(hashtable, hashtable->wheel, sizeof(hashwheel_t));
+            hashtable_free(hashtable, hashtable, sizeof(hashtable_t));
+            return NULL;
+        }
+    }
+    else {
+        if (!options->exact_size)
+            size = hashtable_round_pow2(size);
+        hashtable->size = size;
+        hashtable->table = (hashnode_t **) hashtable_zalloc(hashtable,
+                                               size * sizeof(hashnode_t*));
+        if (hashtable->table == NULL) {
+            hashtable_free(hashtable, hashtable, sizeof(hashtable_t));
+            return NULL;
+        }
+    }
+
+    hashtable->rehash_size = 0;
+    hashtable->rehash_index = 0;
+    hashtable->rehash_table = NULL;
+
+    hashtable->min_size = size;
+    hashtable->exact_size = options->exact_size;
+    hashtable->threads = options->threads > 0 ? options->threads : 1;
+    hashtable->max_load_factor = options->max_load_factor;
+    hashtable->min_load_factor = options->min_load_factor;
+    hashtable->rehash_step = options->rehash_step > 0 ? options->rehash_step
+                                                      : 1;
+
+    hashtable->compare = compare_function;
+    hashtable->hashvalue = hashvalue_function;
+    hashtable->hashvalue_seeded = options->hashvalue_seeded;
+    hashtable->seed = options->seed;
+
+    // Only seeded hash functions use the seed
+    if (hashtable->seed == 0 && hashtable->hashvalue_seeded != NULL)
+        hashtable->seed = (unsigned long) hashtable_table_seed();
+    hashtable->key_delete = key_delete_function;
+    hashtable->value_delete = value_delete_function;
+
+    // Interned copies are freed with the arena
+    hashtable->intern_keys = options->intern_keys;
+    hashtable->intern_values = options->intern_values;
+    hashtable->key_length = options->key_length != NULL
+                            ? options->key_length : hashtable_string_length;
+    hashtable->value_length = options->value_length != NULL
+                              ? options->value_length
+                              : hashtable_string_length;
+    hashtable->arena = NULL;
+    hashtable->arena_used = 0;
+    hashtable->arena_bytes = 0;
+    if (hashtable->intern_keys)
+        hashtable->key_delete = NULL;
+    if (hashtable->intern_values)
+        hashtable->value_delete = NULL;
+
+    return hashtable;
+}
+
+
+/*
+ * Calculates the hash value of a key with the hash function of the table.
+ * Return: Hash value of key.
+ */
+unsigned long hashtable_hash_key(hashtable_t *hashtable, void *key) {
+
+    if (hashtable->hashvalue_seeded != NULL)
+        return hashtable->hashvalue_seeded(key, hashtable->seed);
+
+    return hashtable->hashvalue(key);
+}
+
+/*
+ * Return: Seed the table passes to its seeded hash function.
+ */
+unsigned long hashtable_seed(hashtable_t *hashtable) {
+
+    return hashtable->seed;
+}
+
+/*
+ * Return: Number of keys in the table.
+ */
+unsigned long hashtable_count(hashtable_t *hashtable) {
+
+    if (hashtable == NULL)
+        return 0;
+
+    return hashtable->count;
+}
+
+/*
+ * Finds the bucket where a key with hash value "hash" is, or must be
+ * inserted, taking into account a resize in progress.
+ * Return: Pointer to the head of the bucket list.
+ */
+static hashnode_t **hashtable_bucket(hashtable_t *hashtable,
+                                     unsigned long hash) {
+
+    unsigned long key_pos = 0;
+
+    key_pos = hashtable_calculate_key_position(hashtable, hash,
+                                               hashtable->size);
+
+    if (hashtable->rehash_table != NULL && key_pos < hashtable->rehash_index) {
+        key_pos = hashtable_calculate_key_position(hashtable, hash,
+                                                   hashtable->rehash_size);
+        return &hashtable->rehash_table[key_pos];
+    }
+
+    return &hashtable->table[key_pos];
+}
+
+/*
+ * Moves up to "buckets" non empty buckets from the old bucket array to the
+ * new one. When the old array is empty the resize is finished.
+ */
+static void hashtable_rehash_step(hashtable_t *hashtable,
+                                  unsigned long buckets) {
+
+    unsigned long empty_visits = buckets * HASHTABLE_REHASH_EMPTY_VISITS;
+    unsigned long key_pos = 0;
+    hashnode_t *node = NULL;
+    hashnode_t *node_aux = NULL;
+
+    // Iterators need nodes to stay in their buckets
+    if (hashtable->rehash_table == NULL || hashtable->iterators > 0)
+        return;
+
+    while (buckets > 0 && hashtable->rehash_index < hashtable->size) {
+        node = hashtable->table[hashtable->rehash_index];
+
+        if (node == NULL) {
+            hashtable->rehash_index++;
+            if (--empty_visits == 0)
+                break;
+            continue;
+        }
+
+        // Emptied first, the new array can be the old one grown in place
+        hashtable->table[hashtable->rehash_index] = NULL;
+        while (node != NULL) {
+            node_aux = node->next;
+            key_pos = hashtable_calculate_key_position(hashtable, node->hash,
+                                                       hashtable->rehash_size);
+            node->next = hashtable->rehash_table[key_pos];
+            hashtable->rehash_table[key_pos] = node;
+            node = node_aux;
+        }
+
+        hashtable->rehash_index++;
+        buckets--;
+    }
+
+    // All buckets moved, the new array becomes the main one
+    if (hashtable->rehash_index == hashtable->size) {
+        if (hashtable->table != hashtable->rehash_table)
+            hashtable_free(hashtable, hashtable->table,
+                           hashtable->size * sizeof(hashnode_t*));
+        hashtable->table = hashtable->rehash_table;
+        hashtable->size = hashtable->rehash_size;
+        hashtable->rehash_table = NULL;
+        hashtable->rehash_size = 0;
+        hashtable->rehash_index = 0;
+    }
+}
+
+/*
+ * State of a parallel resize shared by all workers.
+ *
+ * Sizes of power of two tables are multiples of each other, and the nodes
+ * of a bucket b (modulo the smaller size) only go to buckets b (modulo the
+ * smaller size). Every worker owns a range of those "residues" and moves
+ * its nodes directly ("direct" set).
+ *
+ * Otherwise every worker owns a range of the old buckets still to move and
+ * a range of the new buckets (a partition). Nodes go from the old buckets
+ * to "lists", a list per (worker, partition), and from there to the new
+ * buckets of their partition.
+ *
+ * Either way no two workers ever touch the same list or bucket.
+ */
+struct hashrehash_s {
+    hashtable_t *hashtable;
+    unsigned int workers;
+    int direct;
+    unsigned long partition_size;
+    hashnode_t **lists;
+};
+
+struct hashrehash_worker_s {
+    struct hashrehash_s *rehash;
+    unsigned int id;
+    int phase;
+};
+
+typedef struct hashrehash_s hashrehash_t;
+typedef struct hashrehash_worker_s hashrehash_worker_t;
+
+/*
+ * Moves the nodes of an old bucket to their new buckets.
+ */
+static void hashtable_rehash_bucket(hashtable_t *hashtable, unsigned long i) {
+
+    hashnode_t *node = hashtable->table[i];
+    hashnode_t *next = NULL;
+    unsigned long key_pos;
+
+    // Emptied first, the new array can be the old one grown in place
+    hashtable->table[i] = NULL;
+    for (; node != NULL; node = next) {
+        next = node->next;
+        key_pos = hashtable_calculate_key_position(hashtable, node->hash,
+                                                   hashtable->rehash_size);
+        node->next = hashtable->rehash_table[key_pos];
+        hashtable->rehash_table[key_pos] = node;
+    }
+}
+
+/*
+ * Runs one phase of a parallel resize for one worker:
+ * Phase 0: moves the buckets of its range of residues ("direct" set), or
+ * takes the nodes of its range of old buckets and sorts them by partition
+ * of the new bucket array.
+ * Phase 1: links the nodes sorted into its partition into their buckets.
+ */
+static void *hashtable_rehash_worker(void *arg) {
+
+    hashrehash_worker_t *worker = (hashrehash_worker_t *) arg;
+    hashrehash_t *rehash = worker->rehash;
+    hashtable_t *hashtable = rehash->hashtable;
+    hashnode_t **list = NULL;
+    hashnode_t *node = NULL;
+    hashnode_t *next = NULL;
+    unsigned long first, last, span, i;
+    unsigned long key_pos;
+    unsigned int w;
+
+    if (worker->phase == 0 && rehash->direct) {
+        span = hashtable->size < hashtable->rehash_size
+               ? hashtable->size : hashtable->rehash_size;
+        first = span / rehash->workers * worker->id;
+        last = worker->id + 1 == rehash->workers
+               ? span : first + span / rehash->workers;
+
+        for (; first < last; first++)
+            for (i = first; i < hashtable->size; i += span)
+                if (i >= hashtable->rehash_index)
+                    hashtable_rehash_bucket(hashtable, i);
+        return NULL;
+    }
+
+    if (worker->phase == 0) {
+        span = hashtable->size - hashtable->rehash_index;
+        first = hashtable->rehash_index + span / rehash->workers * worker->id;
+        last = worker->id + 1 == rehash->workers
+               ? hashtable->size : first + span / rehash->workers;
+
+        list = rehash->lists + worker->id * rehash->workers;
+        for (i = first; i < last; i++) {
+            for (node = hashtable->table[i]; node != NULL; node = next) {
+                next = node->next;
+                key_pos = hashtable_calculate_key_position(
+                              hashtable, node->hash, hashtable->rehash_size);
+                node->next = list[key_pos / rehash->partition_size];
+                list[key_pos / rehash->partition_size] = node;
+            }
+            hashtable->table[i] = NULL;
+        }
+        return NULL;
+    }
+
+    for (w = 0; w < rehash->workers; w++) {
+        node = rehash->lists[w * rehash->workers + worker->id];
+        for (; node != NULL; node = next) {
+            next = node->next;
+            key_pos = hashtable_calculate_key_position(hashtable, node->hash,
+                                                       hashtable->rehash_size);
+            node->next = hashtable->rehash_table[key_pos];
+            hashtable->rehash_table[key_pos] = node;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Moves all buckets of a resize in progress at once with the threads of the
+ * table, if it has more than one and there are enough buckets to move.
+ * Return: 0 if the resize is finished, -1 if not (nothing was moved).
+ */
+static int hashtable_rehash_parallel(hashtable_t *hashtable) {
+
+    hashrehash_t rehash;
+    hashrehash_worker_t *worker = NULL;
+    unsigned long remaining;
+    unsigned int workers, w;
+
+    if (hashtable->rehash_table == NULL || hashtable->iterators > 0)
+        return -1;
+
+    remaining = hashtable->size - hashtable->rehash_index;
+    workers = hashtable->threads;
+    if (workers > HASHTABLE_MAX_THREADS)
+        workers = HASHTABLE_MAX_THREADS;
+    if (workers > remaining / HASHTABLE_REHASH_THREAD_BUCKETS)
+        workers = remaining / HASHTABLE_REHASH_THREAD_BUCKETS;
+    if (workers > hashtable->rehash_size)
+        workers = hashtable->rehash_size;
+    if (workers < 2)
+        return -1;
+
+    rehash.hashtable = hashtable;
+    rehash.workers = workers;
+    rehash.direct = !hashtable->exact_size;
+    rehash.partition_size = (hashtable->rehash_size + workers - 1) / workers;
+    rehash.lists = NULL;
+    if (!rehash.direct)
+        rehash.lists = (hashnode_t **) calloc (workers * workers,
+                                               sizeof(hashnode_t*));
+    worker = (hashrehash_worker_t *) calloc (workers,
+                                             sizeof(hashrehash_worker_t));
+    if ((!rehash.direct && rehash.lists == NULL) || worker == NULL) {
+        free(rehash.lists);
+        free(worker);
+        return -1;
+    }
+
+    for (w = 0; w < workers; w++) {
+        worker[w].rehash = &rehash;
+        worker[w].id = w;
+    }
+
+    hashtable_run_workers(hashtable_rehash_worker, worker,
+                          sizeof(hashrehash_worker_t), workers);
+
+    if (!rehash.direct) {
+        for (w = 0; w < workers; w++)
+            worker[w].phase = 1;
+        hashtable_run_workers(hashtable_rehash_worker, worker,
+                              sizeof(hashrehash_worker_t), workers);
+    }
+
+    free(rehash.lists);
+    free(worker);
+
+    // Every old bucket is empty, a step of 0 buckets ends the resize
+    hashtable->rehash_index = hashtable->size;
+    hashtable_rehash_step(hashtable, 0);
+
+    return 0;
+}
+
+/*
+ * Moves all remaining buckets of a resize in progress, in parallel if
+ * possible.
+ */
+static void hashtable_rehash_finish(hashtable_t *hashtable) {
+
+    if (hashtable_rehash_parallel(hashtable) != 0)
+        hashtable_rehash_step(hashtable, hashtable->size);
+}
+
+/*
+ * Starts moving the table to a new bucket array of "size" buckets. Nothing
+ * is moved yet, every following operation moves a few buckets.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_resize_start(hashtable_t *hashtable, unsigned long size) {
+
+    hashnode_t **rehash_table = NULL;
+
+    if (hashtable->rehash_table != NULL || size == hashtable->size)
+        return -1;
+
+    rehash_table = (hashnode_t **) hashtable_zalloc(hashtable,
+                                                    size * sizeof(hashnode_t*));
+    if (rehash_table == NULL)
+        return -1;
+
+    hashtable->rehash_table = rehash_table;
+    hashtable->rehash_size = size;
+    hashtable->rehash_index = 0;
+
+    return 0;
+}
+
+/*
+ * Starts a resize if the load factor is out of the configured limits.
+ * A failed resize is not an error, the table keeps working with the current
+ * bucket array and tries again in the next operation.
+ */
+static void hashtable_check_load(hashtable_t *hashtable) {
+
+    unsigned long size = hashtable->size;
+
+    if (hashtable->rehash_table != NULL)
+        return;
+
+    if (hashtable->max_load_factor > 0 &&
+        hashtable->count > size * hashtable->max_load_factor) {
+        if (size * 2 > size)
+            hashtable_resize_start(hashtable, size * 2);
+    }
+    else if (hashtable->min_load_factor > 0 &&
+             size > hashtable->min_size &&
+             hashtable->count < size * hashtable->min_load_factor) {
+        size /= 2;
+        if (size < hashtable->min_size)
+            size = hashtable->min_size;
+        hashtable_resize_start(hashtable, size);
+    }
+
+    // Large tables with several threads resize at once instead of by steps
+    hashtable_rehash_parallel(hashtable);
+}
+
+/*
+ * Introduces or replaces a key-value pair, as hashtable_set(). In a table
+ * with a time to live the key expires "ttl" milliseconds from now, never if
+ * "ttl" is 0.
+ * Return: NULL on error, pointer to the value of the key on success.
+ */
+static void **hashtable_set_value(hashtable_t *hashtable, void *key,
+                                  void *value, unsigned long hash,
+                                  unsigned long ttl) {
+
+    void **slot = NULL;
+    unsigned long index;
+    int inserted;
+
+    if (hashtable->intern_values && value != NULL) {
+        value = hashtable_arena_copy(hashtable, value,
+                                     hashtable->value_length(value));
+        if (value == NULL)
+            return NULL;
+    }
+
+    slot = hashtable_upsert_hashed(hashtable, key, hash, &inserted);
+    if (slot == NULL)
+        return NULL;
+
+    if (!inserted && hashtable->value_delete != NULL)
+        hashtable->value_delete(*slot);
+
+    *slot = value;
+
+    if (hashtable->charges == NULL && hashtable->wheel == NULL)
+        return slot;
+
+    index = hashtable_oa_slot(hashtable, slot);
+
+    // A new value replaces the time to live of the old one
+    if (hashtable->wheel != NULL) {
+        if (hashtable->expires[index] != 0)
+            hashtable_timer_unlink(hashtable, index);
+        hashtable->expires[index] = 0;
+        if (ttl > 0) {
+            hashtable->expires[index] = hashtable_now_ms() + ttl;
+            hashtable_timer_link(hashtable, index);
+        }
+    }
+
+    if (hashtable->charges != NULL)
+        hashtable_cache_charge_slot(hashtable, index);
+
+    return slot;
+}
+
+/*
+ * If the key doesn't exist in the hash table a new key-value pair is introduced
+ * into the hash table, if it exist, it replaces the value with the one passed
+ * as parameter.
+ * Parameter "value" can be NULL.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_set(hashtable_t *hashtable, void *key, void *value) {
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    return hashtable_set_hashed(hashtable, key, value,
+                                hashtable_hash_key(hashtable, key));
+}
+
+/*
+ * Same as hashtable_set(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_set_hashed(hashtable_t *hashtable, void *key, void *value,
+                         unsigned long hash) {
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    return hashtable_set_value(hashtable, key, value, hash, 0) != NULL ? 0
+                                                                       : -1;
+}
+
+/*
+ * Finds the value of a key, introducing the key with a NULL value if it is
+ * not in the table.
+ * Return: NULL on error, pointer to the value of the key on success.
+ */
+void **hashtable_upsert(hashtable_t *hashtable, void *key, int *inserted) {
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    return hashtable_upsert_hashed(hashtable, key,
+                                   hashtable_hash_key(hashtable, key),
+                                   inserted);
+}
+
+/*
+ * Same as hashtable_upsert(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: NULL on error, pointer to the value of the key on success.
+ */
+void **hashtable_upsert_hashed(hashtable_t *hashtable, void *key,
+                               unsigned long hash, int *inserted) {
+
+    hashnode_t **bucket = NULL;
+    hashnode_t *node = NULL;
+    size_t length;
+    int dummy;
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    if (inserted == NULL)
+        inserted = &dummy;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING)
+        return hashtable_oa_upsert(hashtable, key, hash, inserted);
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return NULL;
+
+    hashtable_rehash_step(hashtable, hashtable->rehash_step);
+
+    bucket = hashtable_bucket(hashtable, hash);
+    length = hashtable_key_length(hashtable, key);
+
+    for (node = *bucket; node != NULL; node = node->next) {
+        if (node->hash == hash &&
+            hashtable_key_equal(hashtable, key, length, node->key)) {
+            *inserted = 0;
+            return &node->value;
+        }
+    }
+
+    if (hashtable->intern_keys) {
+        key = hashtable_arena_copy(hashtable, key, length);
+        if (key == NULL)
+            return NULL;
+    }
+
+    node = hashtable_node_create(hashtable, key, NULL, hash, *bucket);
+    if(node == NULL)
+        return NULL;
+    *bucket = node;
+    hashtable->count++;
+
+    // Resizes move nodes between buckets, never to another address
+    hashtable_check_load(hashtable);
+
+    *inserted = 1;
+    return &node->value;
+}
+
+/*
+ * Introduces a key-value pair only if the key is not in the table.
+ * Return: 1 if introduced, 0 if the key was already in the table (nothing
+ * changes), -1 on error.
+ */
+int hashtable_set_if_absent(hashtable_t *hashtable, void *key, void *value) {
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    return hashtable_set_if_absent_hashed(hashtable, key, value,
+                                          hashtable_hash_key(hashtable, key));
+}
+
+/*
+ * Same as hashtable_set_if_absent(), but with the hash value of the key
+ * already calculated by the caller.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_set_if_absent_hashed(hashtable_t *hashtable, void *key,
+                                   void *value, unsigned long hash) {
+
+    void **slot = NULL;
+    int inserted;
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    slot = hashtable_upsert_hashed(hashtable, key, hash, &inserted);
+    if (slot == NULL)
+        return -1;
+
+    if (inserted && hashtable->intern_values && value != NULL) {
+        value = hashtable_arena_copy(hashtable, value,
+                                     hashtable->value_length(value));
+        if (value == NULL) {
+            hashtable_delete_key_hashed(hashtable, key, hash);
+            return -1;
+        }
+    }
+
+    if (inserted) {
+        *slot = value;
+        if (hashtable->charges != NULL)
+            hashtable_cache_charge_slot(hashtable,
+                                        hashtable_oa_slot(hashtable,
+                                                             slot));
+    }
+
+    return inserted;
+}
+
+/*
+ * Same as hashtable_set(), but the key expires "ttl" milliseconds from now
+ * (never if "ttl" is 0). The table must have the "ttl" option.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_set_ttl(hashtable_t *hashtable, void *key, void *value,
+                      unsigned long ttl) {
+
+    if (hashtable == NULL || key == NULL || hashtable->wheel == NULL)
+        return -1;
+
+    return hashtable_set_value(hashtable, key, value,
+                               hashtable_hash_key(hashtable, key),
+                               ttl) != NULL ? 0 : -1;
+}
+
+/*
+ * Removes expired keys of a table with a time to live, looking at most at
+ * "max_keys" keys. Tables also do it a few keys at a time in every
+ * operation, so it is only needed to reclaim memory of idle tables.
+ * Return: Number of keys removed.
+ */
+unsigned long hashtable_expire(hashtable_t *hashtable,
+                               unsigned long max_keys) {
+
+    if (hashtable == NULL || hashtable->wheel == NULL)
+        return 0;
+
+    return hashtable_expire_run(hashtable, hashtable_now_ms(), max_keys);
+}
+
+/*
+ * Gets the value associated to a key.
+ * Return: NULL on error, value on success.
+ */
+void *hashtable_get(hashtable_t *hashtable, void *key){
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    return hashtable_get_hashed(hashtable, key,
+                                hashtable_hash_key(hashtable, key));
+}
+
+/*
+ * Same as hashtable_get(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: NULL on error, value on success.
+ */
+void *hashtable_get_hashed(hashtable_t *hashtable, void *key,
+                           unsigned long hash) {
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING)
+        return hashtable_oa_get(hashtable, key, hash, 1);
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return hashtable_mapped_get(hashtable, key, hash);
+
+    hashtable_rehash_step(hashtable, hashtable->rehash_step);
+
+    return hashtable_peek_hashed(hashtable, key, hash);
+}
+
+/*
+ * Finds the value of a key of a chained or open addressing table without
+ * modifying the table, as hashtable_peek_hashed() does. Expired keys are not
+ * found.
+ * Return: Pointer to the value of the key, NULL if not found.
+ */
+static void **hashtable_peek_slot(hashtable_t *hashtable, void *key,
+                                  unsigned long hash) {
+
+    hashnode_t *node = NULL;
+    unsigned long probes = 0;
+    unsigned long slot;
+    size_t length;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        slot = hashtable_oa_find(hashtable, key, hash, &probes);
+        if (slot != hashtable->size && hashtable_oa_expired(hashtable, slot))
+            slot = hashtable->size;
+        if (hashtable->counters)
+            hashtable_count_lookup(hashtable, slot != hashtable->size,
+                                   probes);
+        return slot != hashtable->size ? &hashtable->slots[slot].value
+                                       : NULL;
+    }
+
+    length = hashtable_key_length(hashtable, key);
+
+    for (node = *hashtable_bucket(hashtable, hash); node != NULL;
+         node = node->next) {
+        probes++;
+        if (node->hash == hash &&
+            hashtable_key_equal(hashtable, key, length, node->key))
+            break;
+    }
+
+    if (hashtable->counters)
+        hashtable_count_lookup(hashtable, node != NULL, probes);
+
+    return node != NULL ? &node->value : NULL;
+}
+
+/*
+ * Same as hashtable_get_hashed(), but never modifies the table: a resize in
+ * progress does not advance.
+ * Return: NULL on error, value on success.
+ */
+void *hashtable_peek_hashed(hashtable_t *hashtable, void *key,
+                            unsigned long hash) {
+
+    void **slot = NULL;
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING)
+        return hashtable_oa_get(hashtable, key, hash, 0);
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return hashtable_mapped_get(hashtable, key, hash);
+
+    slot = hashtable_peek_slot(hashtable, key, hash);
+
+    return slot != NULL ? hashtable_load_value(slot) : NULL;
+}
+
+
+/*
+ * Hashes a chunk of keys and prefetches the memory their lookups read: first
+ * the buckets (or control bytes) of all keys, then the first node (or slots)
+ * of each one and then the key of that node, so the cache misses of all keys
+ * overlap.
+ */
+static void hashtable_prefetch_chunk(hashtable_t *hashtable, void **keys,
+                                     unsigned long *hashes, unsigned long n) {
+
+    hashnode_t **buckets[HASHTABLE_BATCH_CHUNK];
+    hashprobe_t probe;
+    unsigned long i;
+
+    for (i = 0; i < n; i++)
+        hashes[i] = hashtable_hash_key(hashtable, keys[i]);
+
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        for (i = 0; i < n; i++) {
+            hashprobe_start(&probe, hashtable_mix(hashes[i]),
+                            hashtable->size);
+            HASHTABLE_PREFETCH(hashtable->ctrl + probe.offset);
+            HASHTABLE_PREFETCH(&hashtable->slots[probe.offset]);
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        buckets[i] = hashtable_bucket(hashtable, hashes[i]);
+        HASHTABLE_PREFETCH(buckets[i]);
+    }
+
+    for (i = 0; i < n; i++)
+        if (*buckets[i] != NULL)
+            HASHTABLE_PREFETCH(*buckets[i]);
+
+    for (i = 0; i < n; i++)
+        if (*buckets[i] != NULL)
+            HASHTABLE_PREFETCH((*buckets[i])->key);
+}
+
+/*
+ * Gets the values associated to "n" keys, in chunks of keys whose memory
+ * accesses are overlapped with prefetching.
+ * Parameter "values" must have room for "n" values, values[i] is NULL if
+ * keys[i] is NULL or not found.
+ * Return: Number of keys found, or 0 on error.
+ */
+unsigned long hashtable_get_batch(hashtable_t *hashtable, void **keys,
+                                  unsigned long n, void **values) {
+
+    unsigned long hashes[HASHTABLE_BATCH_CHUNK];
+    unsigned long found = 0;
+    unsigned long chunk;
+    unsigned long i, j;
+
+    if (hashtable == NULL || keys == NULL || values == NULL)
+        return 0;
+
+    for (i = 0; i < n; i += chunk) {
+        chunk = n - i < HASHTABLE_BATCH_CHUNK ? n - i : HASHTABLE_BATCH_CHUNK;
+
+        for (j = 0; j < chunk; j++)
+            if (keys[i + j] == NULL)
+                break;
+
+        // Chunks with NULL keys are looked up one by one
+        if (j < chunk) {
+            for (j = 0; j < chunk; j++) {
+                values[i + j] = hashtable_get(hashtable, keys[i + j]);
+                if (values[i + j] != NULL)
+                    found++;
+            }
+            continue;
+        }
+
+        hashtable_prefetch_chunk(hashtable, keys + i, hashes, chunk);
+
+        for (j = 0; j < chunk; j++) {
+            values[i + j] = hashtable_get_hashed(hashtable, keys[i + j],
+                                                 hashes[j]);
+            if (values[i + j] != NULL)
+                found++;
+        }
+    }
+
+    return found;
+}
+
+/*
+ * Sets "n" key-value pairs as hashtable_set() does, in chunks of keys whose
+ * memory accesses are overlapped with prefetching.
+ * Parameter "values" can be NULL to set all values to NULL.
+ * Return: 0 on success, -1 if any pair could not be set (the rest are set).
+ */
+int hashtable_set_batch(hashtable_t *hashtable, void **keys, void **values,
+                        unsigned long n) {
+
+    unsigned long hashes[HASHTABLE_BATCH_CHUNK];
+    unsigned long chunk;
+    unsigned long i, j;
+    int result = 0;
+
+    if (hashtable == NULL || keys == NULL)
+        return -1;
+
+    for (i = 0; i < n; i += chunk) {
+        chunk = n - i < HASHTABLE_BATCH_CHUNK ? n - i : HASHTABLE_BATCH_CHUNK;
+
+        for (j = 0; j < chunk; j++)
+            if (keys[i + j] == NULL)
+                break;
+
+        if (j < chunk) {
+            for (j = 0; j < chunk; j++)
+                if (hashtable_set(hashtable, keys[i + j],
+                                  values != NULL ? values[i + j] : NULL) != 0)
+                    result = -1;
+            continue;
+        }
+
+        hashtable_prefetch_chunk(hashtable, keys + i, hashes, chunk);
+
+        for (j = 0; j < chunk; j++)
+            if (hashtable_set_hashed(hashtable, keys[i + j],
+                                     values != NULL ? values[i + j] : NULL,
+                                     hashes[j]) != 0)
+                result = -1;
+    }
+
+    return result;
+}
+
+/*
+ * Moves forward the iterators whose next node is "node", which is about to
+ * be deleted. "node" is already unlinked from its chain but still points to
+ * the node that followed it.
+ */
+static void hashtable_iterators_skip(hashtable_t *hashtable,
+                                     hashnode_t *node) {
+
+    hashtable_iterator_t *iterator = NULL;
+
+    for (iterator = hashtable->iterator_list; iterator != NULL;
+         iterator = iterator->next)
+        if (iterator->node == node)
+            iterator->node = node->next;
+}
+
+/*
+ * Removes a key-value pair. The key is freed with the key delete function.
+ * If "value" is NULL the value is freed with the value delete function,
+ * otherwise it is stored in "*value" and not freed.
+ * Return: -1 on error, 0 on success (also if the key was not in the table).
+ */
+static int hashtable_remove(hashtable_t *hashtable, void *key,
+                            unsigned long hash, void **value) {
+
+    hashnode_t **link = NULL;
+    hashnode_t *node = NULL;
+    size_t length;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING)
+        return hashtable_oa_remove(hashtable, key, hash, value);
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return -1;
+
+    hashtable_rehash_step(hashtable, hashtable->rehash_step);
+
+    link = hashtable_bucket(hashtable, hash);
+    length = hashtable_key_length(hashtable, key);
+
+    while ((node = *link) != NULL) {
+
+        if (node->hash == hash &&
+            hashtable_key_equal(hashtable, key, length, node->key)) {
+            *link = node->next;
+
+            if (hashtable->iterator_list != NULL)
+                hashtable_iterators_skip(hashtable, node);
+            if (hashtable->key_delete != NULL)
+                hashtable->key_delete(node->key);
+            if (value != NULL)
+                *value = node->value;
+            else if (hashtable->value_delete != NULL)
+                hashtable->value_delete(node->value);
+
+            hashtable_node_delete(hashtable, node);
+            hashtable->count--;
+
+            hashtable_check_load(hashtable);
+            return 0;
+        }
+
+        link = &node->next;
+    }
+
+    return 0;
+}
+
+/*
+ * Deletes a key and its associated value from a hash table.
+ * Return: -1 on error, 0 on success.
+ */
+int hashtable_delete_key(hashtable_t *hashtable, void *key) {
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    return hashtable_delete_key_hashed(hashtable, key,
+                                       hashtable_hash_key(hashtable, key));
+}
+
+/*
+ * Same as hashtable_delete_key(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: -1 on error, 0 on success.
+ */
+int hashtable_delete_key_hashed(hashtable_t *hashtable, void *key,
+                                unsigned long hash) {
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    return hashtable_remove(hashtable, key, hash, NULL);
+}
+
+/*
+ * Removes a key-value pair and returns its value instead of freeing it. The
+ * key is freed with the key delete function.
+ * Return: Value of the key, NULL if not found or on error.
+ */
+void *hashtable_take(hashtable_t *hashtable, void *key) {
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    return hashtable_take_hashed(hashtable, key,
+                                 hashtable_hash_key(hashtable, key));
+}
+
+/*
+ * Same as hashtable_take(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: Value of the key, NULL if not found or on error.
+ */
+void *hashtable_take_hashed(hashtable_t *hashtable, void *key,
+                            unsigned long hash) {
+
+    void *value = NULL;
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    hashtable_remove(hashtable, key, hash, &value);
+
+    return value;
+}
+
+/*
+ * Frees all nodes of a bucket array of "size" buckets and empties its
+ * buckets. Pooled nodes are not released, they go back to the pool with
+ * hashtable_pool_reset() or are freed with hashtable_pool_delete().
+ */
+static void hashtable_clear_buckets(hashtable_t *hashtable,
+                                    hashnode_t **table, unsigned long size) {
+
+    hashnode_t *node = NULL;
+    hashnode_t *node_aux = NULL;
+    unsigned long i;
+
+    // Pooled nodes are released with their slabs, only keys and values remain
+    if (hashtable->slab_size > 0 &&
+        hashtable->key_delete == NULL && hashtable->value_delete == NULL) {
+        memset(table, 0, size * sizeof(hashnode_t*));
+        return;
+    }
+
+    for (i = 0; i < size; i++) {
+        node = table[i];
+
+        //delete all possible lists
+        while (node != NULL) {
+            node_aux = node;
+            node = node->next;
+
+            if (hashtable->key_delete != NULL)
+                hashtable->key_delete(node_aux->key);
+            if (hashtable->value_delete != NULL)
+                hashtable->value_delete(node_aux->value);
+
+            if (hashtable->slab_size == 0)
+                hashtable_free(hashtable, node_aux, sizeof(hashnode_t));
+            node_aux = NULL;
+        }
+
+        table[i] = NULL;
+    }
+}
+
+/*
+ * Frees all nodes of a bucket array of "size" buckets and the array.
+ */
+static void hashtable_delete_buckets(hashtable_t *hashtable,
+                                     hashnode_t **table, unsigned long size) {
+
+    hashtable_clear_buckets(hashtable, table, size);
+    hashtable_free(hashtable, table, size * sizeof(hashnode_t*));
+}
+
+/*
+ * Frees all allocated memory in a hash table.
+ */
+void hashtable_delete(hashtable_t *hashtable) {
+
+    if (hashtable == NULL)
+        return;
+
+    hashtable_arena_delete(hashtable);
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        hashtable_oa_delete(hashtable);
+        hashtable_free(hashtable, hashtable, sizeof(hashtable_t));
+        return;
+    }
+
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED) {
+        munmap(hashtable->map, hashtable->map_size);
+        hashtable_free(hashtable, hashtable, sizeof(hashtable_t));
+        return;
+    }
+
+    hashtable_delete_buckets(hashtable, hashtable->table, hashtable->size);
+
+    if (hashtable->rehash_table != NULL)
+        hashtable_delete_buckets(hashtable, hashtable->rehash_table,
+                                 hashtable->rehash_size);
+
+    hashtable_pool_delete(hashtable);
+    hashtable_free(hashtable, hashtable, sizeof(hashtable_t));
+
+    return;
+}
+
+
+/**** CAPACITY FUNCTIONS ******************************************************/
+
+/*
+ * Removes all key-value pairs of a hash table, freeing keys and values with
+ * the delete functions of the table. The bucket array (or slots), the node
+ * pool and the newest chunk of the arena are kept for the keys introduced
+ * later. Without delete functions an open addressing or pooled table is
+ * emptied without visiting its keys.
+ */
+void hashtable_clear(hashtable_t *hashtable) {
+
+    hashtable_iterator_t *iterator = NULL;
+
+    if (hashtable == NULL || hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        hashtable_oa_clear(hashtable);
+        hashtable_arena_reset(hashtable);
+        return;
+    }
+
+    hashtable_clear_buckets(hashtable, hashtable->table, hashtable->size);
+
+    // Iterators find no more nodes
+    for (iterator = hashtable->iterator_list; iterator != NULL;
+         iterator = iterator->next)
+        iterator->node = NULL;
+
+    // An unfinished resize ends here, keeping the new bucket array
+    if (hashtable->rehash_table != NULL) {
+        hashtable_clear_buckets(hashtable, hashtable->rehash_table,
+                                hashtable->rehash_size);
+        hashtable_free(hashtable, hashtable->table,
+                       hashtable->size * sizeof(hashnode_t*));
+        hashtable->table = hashtable->rehash_table;
+        hashtable->size = hashtable->rehash_size;
+        hashtable->rehash_table = NULL;
+        hashtable->rehash_size = 0;
+        hashtable->rehash_index = 0;
+    }
+
+    hashtable_pool_reset(hashtable);
+    hashtable_arena_reset(hashtable);
+    hashtable->count = 0;
+}
+
+/*
+ * Starts growing a power of two table in its own bucket array, resized by
+ * the allocator (without copying it, when the allocator can). The nodes of
+ * old bucket i only go to bucket i and to new buckets (i plus multiples of
+ * the old size), so the resize must be finished before any other operation.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_resize_in_place(hashtable_t *hashtable,
+                                     unsigned long size) {
+
+    hashnode_t **table = NULL;
+
+    if (hashtable->rehash_table != NULL || hashtable->exact_size ||
+        size <= hashtable->size)
+        return -1;
+
+    table = (hashnode_t **) hashtable_realloc(hashtable, hashtable->table,
+                                              hashtable->size *
+                                              sizeof(hashnode_t*),
+                                              size * sizeof(hashnode_t*));
+    if (table == NULL)
+        return -1;
+
+    memset(table + hashtable->size, 0,
+           (size - hashtable->size) * sizeof(hashnode_t*));
+    hashtable->table = table;
+    hashtable->rehash_table = table;
+    hashtable->rehash_size = size;
+    hashtable->rehash_index = 0;
+
+    return 0;
+}
+
+/*
+ * Moves a chained table to a bucket array of "size" buckets at once,
+ * finishing first any resize in progress.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_resize_now(hashtable_t *hashtable, unsigned long size) {
+
+    if (hashtable->iterators > 0)
+        return -1;
+
+    hashtable_rehash_finish(hashtable);
+
+    if (size == hashtable->size)
+        return 0;
+
+    if (hashtable_resize_in_place(hashtable, size) != 0 &&
+        hashtable_resize_start(hashtable, size) != 0)
+        return -1;
+
+    hashtable_rehash_finish(hashtable);
+
+    return 0;
+}
+
+/*
+ * Return: Number of keys a chained table of "size" buckets holds without
+ * growing.
+ */
+static unsigned long hashtable_capacity(hashtable_t *hashtable,
+                                        unsigned long size) {
+
+    if (hashtable->max_load_factor == 0)
+        return size;
+
+    return size * hashtable->max_load_factor;
+}
+
+/*
+ * Grows a hash table so that it holds "n" keys without resizing. The whole
+ * table is moved at once, so introducing a known number of keys after it
+ * never rehashes. A table that already holds "n" keys is not changed.
+ * Return: 0 on success, -1 on error (no memory, mapped table, or iterators
+ * in use).
+ */
+int hashtable_reserve(hashtable_t *hashtable, unsigned long n) {
+
+    unsigned long size;
+
+    if (hashtable == NULL || hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return -1;
+
+    if (hashtable->iterators > 0)
+        return -1;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        size = hashtable->size;
+        while (hashtable_oa_limit(hashtable, size) < n) {
+            if (size * 2 < size)
+                return -1;
+            size *= 2;
+        }
+        if (size == hashtable->size)
+            return 0;
+        return hashtable_oa_resize(hashtable, size);
+    }
+
+    size = hashtable->rehash_table != NULL ? hashtable->rehash_size
+                                           : hashtable->size;
+    while (hashtable_capacity(hashtable, size) < n) {
+        if (size * 2 < size)
+            return -1;
+        size *= 2;
+    }
+
+    return hashtable_resize_now(hashtable, size);
+}
+
+/*
+ * Shrinks a hash table to the fewest buckets (or slots) that hold its keys
+ * without growing, never below its initial size, and removes the tombstones
+ * of an open addressing table. The node pool and the arena keep their
+ * memory.
+ * Return: 0 on success, -1 on error (no memory, mapped table, or iterators
+ * in use).
+ */
+int hashtable_shrink_to_fit(hashtable_t *hashtable) {
+
+    unsigned long size;
+
+    if (hashtable == NULL || hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return -1;
+
+    if (hashtable->iterators > 0)
+        return -1;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        size = hashtable->size;
+        while (size / 2 >= hashtable->min_size &&
+               hashtable_oa_limit(hashtable, size / 2) >= hashtable->count)
+            size /= 2;
+        if (size == hashtable->size && hashtable->tombstones == 0)
+            return 0;
+        return hashtable_oa_resize(hashtable, size);
+    }
+
+    size = hashtable->rehash_table != NULL ? hashtable->rehash_size
+                                           : hashtable->size;
+    while (size / 2 >= hashtable->min_size &&
+           hashtable_capacity(hashtable, size / 2) >= hashtable->count)
+        size /= 2;
+
+    return hashtable_resize_now(hashtable, size);
+}
+
+
+/**** STATISTICS FUNCTIONS ****************************************************/
+
+/*
+ * Adds a chain (or probe sequence) of "length" to the statistics.
+ */
+static void hashtable_stats_add_chain(hashtable_stats_t *stats,
+                                      unsigned long length) {
+
+    if (length >= HASHTABLE_STATS_HISTOGRAM_SIZE)
+        stats->chain_histogram[HASHTABLE_STATS_HISTOGRAM_SIZE - 1]++;
+    else
+        stats->chain_histogram[length]++;
+
+    if (length > stats->max_chain)
+        stats->max_chain = length;
+}
+
+/*
+ * Fills the bucket statistics of a chained table.
+ */
+static void hashtable_stats_chained(hashtable_t *hashtable,
+                                    hashtable_stats_t *stats) {
+
+    hashnode_t **table = NULL;
+    hashnode_t *node = NULL;
+    hashslab_t *slab = NULL;
+    unsigned long size, i, length;
+    int phase;
+
+    for (phase = 0; phase < 2; phase++) {
+        table = phase == 0 ? hashtable->table : hashtable->rehash_table;
+        size = phase == 0 ? hashtable->size : hashtable->rehash_size;
+        for (i = 0; table != NULL && i < size; i++) {
+            length = 0;
+            for (node = table[i]; node != NULL; node = node->next)
+                length++;
+            hashtable_stats_add_chain(stats, length);
+        }
+        if (table != NULL)
+            stats->buckets += size;
+    }
+
+    stats->empty_buckets = stats->chain_histogram[0];
+    stats->bucket_bytes = stats->buckets * sizeof(hashnode_t*);
+
+    if (hashtable->slab_size == 0) {
+        stats->node_bytes = hashtable->count * sizeof(hashnode_t);
+        return;
+    }
+
+    for (slab = hashtable->slabs; slab != NULL; slab = slab->next)
+        stats->node_bytes += sizeof(hashslab_t) +
+                             slab->size * sizeof(hashnode_t);
+}
+
+/*
+ * Fills the slot statistics of an open addressing table. Every key is
+ * searched again to know how many groups its lookup visits.
+ */
+static void hashtable_stats_oa(hashtable_t *hashtable,
+                               hashtable_stats_t *stats) {
+
+    unsigned long i, groups;
+
+    for (i = 0; i < hashtable->size; i++) {
+        if (hashtable->ctrl[i] == HASHTABLE_CTRL_EMPTY) {
+            stats->empty_buckets++;
+        }
+        else if (hashtable->ctrl[i] != HASHTABLE_CTRL_DELETED) {
+            hashtable_oa_find(hashtable, hashtable->slots[i].key,
+                              hashtable_hash_key(hashtable,
+                                                 hashtable->slots[i].key),
+                              &groups);
+            hashtable_stats_add_chain(stats, groups);
+        }
+    }
+
+    stats->buckets = hashtable->size;
+    stats->tombstones = hashtable->tombstones;
+    stats->bucket_bytes = hashtable_oa_bytes(hashtable, hashtable->size);
+}
+
+/*
+ * Fills the bucket statistics of a mapped table.
+ */
+static void hashtable_stats_mapped(hashtable_t *hashtable,
+                                  hashtable_stats_t *stats) {
+
+    hashsnapshot_entry_t *entry = NULL;
+    unsigned long i, length;
+
+    for (i = 0; i < hashtable->size; i++) {
+        length = 0;
+        for (entry = hashtable_mapped_bucket(hashtable, i); entry != NULL;
+             entry = hashtable_mapped_entry(hashtable, entry->next))
+            length++;
+        hashtable_stats_add_chain(stats, length);
+    }
+
+    stats->buckets = hashtable->size;
+    stats->empty_buckets = stats->chain_histogram[0];
+    stats->bucket_bytes = hashtable->size * sizeof(uint64_t);
+    stats->node_bytes = hashtable->map_size - sizeof(hashsnapshot_header_t) -
+                        stats->bucket_bytes;
+}
+
+/*
+ * Fills "stats" with the statistics of a table. It reads every bucket.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_stats(hashtable_t *hashtable, hashtable_stats_t *stats) {
+
+    if (hashtable == NULL || stats == NULL)
+        return -1;
+
+    memset(stats, 0, sizeof(hashtable_stats_t));
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING)
+        hashtable_stats_oa(hashtable, stats);
+    else if (hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        hashtable_stats_mapped(hashtable, stats);
+    else
+        hashtable_stats_chained(hashtable, stats);
+
+    stats->count = hashtable->count;
+    stats->resizing = hashtable->rehash_table != NULL;
+    stats->arena_bytes = hashtable->arena_bytes;
+    stats->cache_bytes = hashtable->bytes;
+    stats->evictions = hashtable->evictions;
+    stats->expirations = hashtable->expirations;
+    stats->total_bytes = sizeof(hashtable_t) + stats->bucket_bytes +
+                         stats->node_bytes + stats->arena_bytes;
+    if (hashtable->wheel != NULL)
+        stats->total_bytes += sizeof(hashwheel_t);
+
+    stats->lookups = atomic_load_explicit(&hashtable->lookups,
+                                          memory_order_relaxed);
+    stats->hits = atomic_load_explicit(&hashtable->hits,
+                                       memory_order_relaxed);
+    stats->misses = atomic_load_explicit(&hashtable->misses,
+                                         memory_order_relaxed);
+    stats->probes = atomic_load_explicit(&hashtable->probes,
+                                         memory_order_relaxed);
+
+    hashtable_stats_ratios(stats);
+
+    return 0;
+}
+
+/*
+ * Calculates the ratios of "stats" from its counts.
+ */
+void hashtable_stats_ratios(hashtable_stats_t *stats) {
+
+    stats->load_factor = stats->buckets > 0
+                         ? (float) stats->count / stats->buckets : 0;
+    stats->empty_bucket_ratio = stats->buckets > 0
+                                ? (float) stats->empty_buckets / stats->buckets
+                                : 0;
+    stats->average_probes = stats->lookups > 0
+                            ? (float) stats->probes / stats->lookups : 0;
+}
+
+/*
+ * Sets the lookup counters of a table to 0.
+ */
+void hashtable_stats_reset(hashtable_t *hashtable) {
+
+    if (hashtable != NULL)
+        hashtable_reset_counters(hashtable);
+}
+
+
+/**** ITERATION FUNCTIONS *****************************************************/
+
+/*
+ * Starts iterating over all key-value pairs of a table. Resizes of chained
+ * tables are paused until the iterator ends or is released.
+ */
+void hashtable_iterator_init(hashtable_t *hashtable,
+                             hashtable_iterator_t *iterator) {
+
+    if (iterator == NULL)
+        return;
+
+    iterator->hashtable = hashtable;
+    iterator->index = 0;
+    iterator->phase = 0;
+    iterator->node = NULL;
+
+    iterator->next = NULL;
+
+    if (hashtable == NULL) {
+        iterator->phase = 2;
+        return;
+    }
+
+    hashtable->iterators++;
+    iterator->next = hashtable->iterator_list;
+    hashtable->iterator_list = iterator;
+}
+
+/*
+ * Gets the next key-value pair of an iteration.
+ * Return: 1 if a pair was returned, 0 at the end of the iteration.
+ */
+int hashtable_iterator_next(hashtable_iterator_t *iterator, void **key,
+                            void **value) {
+
+    hashtable_t *hashtable = NULL;
+    hashnode_t *node = NULL;
+    hashnode_t **table = NULL;
+    hashsnapshot_entry_t *entry = NULL;
+    unsigned long size;
+
+    if (iterator == NULL || iterator->phase == 2)
+        return 0;
+
+    hashtable = iterator->hashtable;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        for (; iterator->index < hashtable->size; iterator->index++) {
+            if (hashtable->ctrl[iterator->index] < 0)
+                continue;
+            if (key != NULL)
+                *key = hashtable->slots[iterator->index].key;
+            if (value != NULL)
+                *value = hashtable->slots[iterator->index].value;
+            iterator->index++;
+            return 1;
+        }
+        hashtable_iterator_release(iterator);
+        return 0;
+    }
+
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED) {
+        while (iterator->node == NULL) {
+            if (iterator->index >= hashtable->size) {
+                hashtable_iterator_release(iterator);
+                return 0;
+            }
+            iterator->node = hashtable_mapped_bucket(hashtable,
+                                                     iterator->index++);
+        }
+        entry = (hashsnapshot_entry_t *) iterator->node;
+        iterator->node = hashtable_mapped_entry(hashtable, entry->next);
+        if (key != NULL)
+            *key = hashtable_mapped_key(entry);
+        if (value != NULL)
+            *value = hashtable_mapped_value(entry);
+        return 1;
+    }
+
+    // Next node is read in advance, so the returned key can be deleted, and
+    // hashtable_remove() moves it forward if it is the one deleted
+    while (iterator->node == NULL) {
+        if (iterator->phase == 0) {
+            table = hashtable->table;
+            size = hashtable->size;
+        }
+        else {
+            table = hashtable->rehash_table;
+            size = hashtable->rehash_size;
+        }
+
+        if (table == NULL || iterator->index >= size) {
+            if (iterator->phase == 0 && hashtable->rehash_table != NULL) {
+                iterator->phase = 1;
+                iterator->index = 0;
+                continue;
+            }
+            hashtable_iterator_release(iterator);
+            return 0;
+        }
+
+        iterator->node = table[iterator->index++];
+    }
+
+    node = (hashnode_t *) iterator->node;
+    iterator->node = node->next;
+
+    if (key != NULL)
+        *key = node->key;
+    if (value != NULL)
+        *value = node->value;
+
+    return 1;
+}
+
+/*
+ * Ends an iteration before hashtable_iterator_next() returns 0. Calling it
+ * again, or after the iteration ended, does nothing.
+ */
+void hashtable_iterator_release(hashtable_iterator_t *iterator) {
+
+    hashtable_iterator_t **link = NULL;
+
+    if (iterator == NULL || iterator->phase == 2)
+        return;
+
+    iterator->phase = 2;
+    iterator->node = NULL;
+    iterator->hashtable->iterators--;
+
+    for (link = &iterator->hashtable->iterator_list; *link != NULL;
+         link = &(*link)->next) {
+        if (*link == iterator) {
+            *link = iterator->next;
+            break;
+        }
+    }
+}
+
+/*
+ * Reverses the bits of a cursor.
+ * Return: Reversed cursor.
+ */
+static unsigned long hashtable_reverse_bits(unsigned long value) {
+
+    unsigned long reversed = 0;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(value) * 8; i++) {
+        reversed = (reversed << 1) | (value & 1);
+        value >>= 1;
+    }
+
+    return reversed;
+}
+
+/*
+ * Increments the bits of a cursor not in "mask" from the most significant
+ * one down, so every table size visits buckets in an order compatible with
+ * the bigger and smaller sizes.
+ * Return: Next cursor, 0 after the last bucket.
+ */
+static unsigned long hashtable_scan_next(unsigned long cursor,
+                                         unsigned long mask) {
+
+    cursor |= ~mask;
+    cursor = hashtable_reverse_bits(cursor);
+    cursor++;
+    return hashtable_reverse_bits(cursor);
+}
+
+/*
+ * Calls "function" for every node of a bucket list.
+ */
+static void hashtable_scan_bucket(hashnode_t *node, fp_scan function,
+                                  void *data) {
+
+    for (; node != NULL; node = node->next)
+        function(node->key, node->value, data);
+}
+
+/*
+ * Scans tables without power of two bucket masks (open addressing, mapped and
+ * "exact_size" tables): the cursor is the next position of the main array.
+ * Return: Next cursor, 0 when the scan is finished.
+ */
+static unsigned long hashtable_scan_linear(hashtable_t *hashtable,
+                                           unsigned long cursor,
+                                           unsigned long steps,
+                                           fp_scan function, void *data) {
+
+    hashsnapshot_entry_t *entry = NULL;
+    unsigned long first, last;
+
+    for (; steps > 0 && cursor < hashtable->size; steps--, cursor++) {
+
+        if (hashtable->backend == HASHTABLE_BACKEND_MAPPED) {
+            for (entry = hashtable_mapped_bucket(hashtable, cursor);
+                 entry != NULL;
+                 entry = hashtable_mapped_entry(hashtable, entry->next))
+                function(hashtable_mapped_key(entry),
+                         hashtable_mapped_value(entry), data);
+            continue;
+        }
+
+        if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+            if (hashtable->ctrl[cursor] >= 0)
+                function(hashtable->slots[cursor].key,
+                         hashtable->slots[cursor].value, data);
+            continue;
+        }
+
+        hashtable_scan_bucket(hashtable->table[cursor], function, data);
+
+        if (hashtable->rehash_table == NULL)
+            continue;
+
+        // Buckets of the new array whose hash range overlaps this bucket
+        first = (unsigned long) ((double) cursor * hashtable->rehash_size /
+                                 hashtable->size);
+        last = (unsigned long) ((double) (cursor + 1) *
+                                hashtable->rehash_size / hashtable->size);
+        if (first > 0)
+            first--;
+        for (; first <= last && first < hashtable->rehash_size; first++)
+            hashtable_scan_bucket(hashtable->rehash_table[first], function,
+                                  data);
+    }
+
+    return cursor < hashtable->size ? cursor : 0;
+}
+
+/*
+ * Visits "steps" buckets of a table starting at "cursor", calling "function"
+ * for every key-value pair found.
+ * Return: Cursor for the next call, 0 when the scan is finished.
+ */
+unsigned long hashtable_scan(hashtable_t *hashtable, unsigned long cursor,
+                             unsigned long steps, fp_scan function,
+                             void *data) {
+
+    hashnode_t **small_table, **big_table;
+    unsigned long small_mask, big_mask;
+
+    if (hashtable == NULL || function == NULL)
+        return 0;
+
+    if (steps == 0)
+        steps = 1;
+
+    if (hashtable->backend != HASHTABLE_BACKEND_CHAINED ||
+        hashtable->exact_size)
+        return hashtable_scan_linear(hashtable, cursor, steps, function,
+                                     data);
+
+    do {
+        if (hashtable->rehash_table == NULL) {
+            small_mask = hashtable->size - 1;
+            hashtable_scan_bucket(hashtable->table[cursor & small_mask],
+                                  function, data);
+            cursor = hashtable_scan_next(cursor, small_mask);
+            continue;
+        }
+
+        if (hashtable->size <= hashtable->rehash_size) {
+            small_table = hashtable->table;
+            small_mask = hashtable->size - 1;
+            big_table = hashtable->rehash_table;
+            big_mask = hashtable->rehash_size - 1;
+        }
+        else {
+            small_table = hashtable->rehash_table;
+            small_mask = hashtable->rehash_size - 1;
+            big_table = hashtable->table;
+            big_mask = hashtable->size - 1;
+        }
+
+        // The bucket of the small array and all its expansions in the big one
+        hashtable_scan_bucket(small_table[cursor & small_mask], function,
+                              data);
+        do {
+            hashtable_scan_bucket(big_table[cursor & big_mask], function,
+                                  data);
+            cursor = hashtable_scan_next(cursor, big_mask);
+        } while (cursor & (small_mask ^ big_mask));
+
+    } while (cursor != 0 && --steps > 0);
+
+    return cursor;
+}
+
+
+/**** INTEGER VALUE FUNCTIONS *************************************************/
+
+/*
+ * Return: 1 if the values of a table can be used as integers, 0 if not: they
+ * cannot be freed or copied by the table, nor measured by a cache.
+ */
+static int hashtable_integer_values(hashtable_t *hashtable) {
+
+    return hashtable->backend != HASHTABLE_BACKEND_MAPPED &&
+           hashtable->value_delete == NULL && !hashtable->intern_values &&
+           hashtable->max_bytes == 0;
+}
+
+/*
+ * Adds "delta" to the counter of a key, introducing it at 0 if needed.
+ * Return: 1 if introduced, 0 if already there, -1 on error.
+ */
+int hashtable_incr(hashtable_t *hashtable, void *key, long delta,
+                   long *count) {
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    return hashtable_incr_hashed(hashtable, key, delta,
+                                 hashtable_hash_key(hashtable, key), count);
+}
+
+/*
+ * Same as hashtable_incr(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: 1 if introduced, 0 if already there, -1 on error.
+ */
+int hashtable_incr_hashed(hashtable_t *hashtable, void *key, long delta,
+                          unsigned long hash, long *count) {
+
+    void **slot = NULL;
+    intptr_t value;
+    int inserted;
+
+    if (hashtable == NULL || key == NULL ||
+        !hashtable_integer_values(hashtable))
+        return -1;
+
+    slot = hashtable_upsert_hashed(hashtable, key, hash, &inserted);
+    if (slot == NULL)
+        return -1;
+
+    // A new key has a NULL value, counter 0
+    value = (intptr_t) *slot + delta;
+    *slot = (void *) value;
+
+    if (count != NULL)
+        *count = value;
+
+    return inserted;
+}
+
+/*
+ * Adds "delta" to the counter of a key already in the table with an atomic
+ * fetch-add, without modifying anything else.
+ * Return: 0 if added, -1 if the key is not in the table or on error.
+ */
+int hashtable_incr_shared_hashed(hashtable_t *hashtable, void *key,
+                                 long delta, unsigned long hash,
+                                 long *count) {
+
+    void **slot = NULL;
+    intptr_t value;
+
+    if (hashtable == NULL || key == NULL ||
+        !hashtable_integer_values(hashtable))
+        return -1;
+
+    slot = hashtable_peek_slot(hashtable, key, hash);
+    if (slot == NULL)
+        return -1;
+
+    value = atomic_fetch_add_explicit((_Atomic intptr_t *) slot,
+                                      (intptr_t) delta,
+                                      memory_order_relaxed) + delta;
+
+    if (count != NULL)
+        *count = value;
+
+    return 0;
+}
+
+/*
+ * Moves the element "i" of a min-heap of counters down to its place.
+ */
+static void hashtable_heap_down(void **keys, long *counts, unsigned long n,
+                                unsigned long i) {
+
+    unsigned long child;
+    void *key = keys[i];
+    long count = counts[i];
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n && counts[child + 1] < counts[child])
+            child++;
+        if (counts[child] >= count)
+            break;
+        keys[i] = keys[child];
+        counts[i] = counts[child];
+        i = child;
+    }
+
+    keys[i] = key;
+    counts[i] = count;
+}
+
+/*
+ * Offers a key to a min-heap of the "k" largest counters holding "*n" keys.
+ */
+static void hashtable_heap_offer(void **keys, long *counts, unsigned long k,
+                                 unsigned long *n, void *key, long count) {
+
+    unsigned long i, parent;
+
+    if (*n == k) {
+        if (count <= counts[0])
+            return;
+        keys[0] = key;
+        counts[0] = count;
+        hashtable_heap_down(keys, counts, k, 0);
+        return;
+    }
+
+    // Moved up from the end of the heap
+    for (i = (*n)++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (counts[parent] <= count)
+            break;
+        keys[i] = keys[parent];
+        counts[i] = counts[parent];
+    }
+    keys[i] = key;
+    counts[i] = count;
+}
+
+/*
+ * Offers every key of a bucket array of "size" buckets to a min-heap.
+ */
+static void hashtable_top_k_buckets(hashnode_t **table, unsigned long size,
+                                    void **keys, long *counts,
+                                    unsigned long k, unsigned long *n) {
+
+    hashnode_t *node = NULL;
+    unsigned long i;
+
+    for (i = 0; i < size; i++)
+        for (node = table[i]; node != NULL; node = node->next)
+            hashtable_heap_offer(keys, counts, k, n, node->key,
+                                 (long) (intptr_t)
+                                 hashtable_load_value(&node->value));
+}
+
+/*
+ * Finds the "k" keys with the largest counters.
+ * Return: Number of keys written, at most "k".
+ */
+unsigned long hashtable_top_k(hashtable_t *hashtable, unsigned long k,
+                              void **keys, long *counts) {
+
+    unsigned long n = 0;
+    unsigned long i;
+    void *key = NULL;
+    long count;
+
+    if (hashtable == NULL || keys == NULL || counts == NULL || k == 0 ||
+        !hashtable_integer_values(hashtable))
+        return 0;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        for (i = 0; i < hashtable->size; i++)
+            if (hashtable->ctrl[i] >= 0 &&
+                !hashtable_oa_expired(hashtable, i))
+                hashtable_heap_offer(keys, counts, k, &n,
+                                     hashtable->slots[i].key,
+                                     (long) (intptr_t)
+                                     hashtable_load_value(
+                                         &hashtable->slots[i].value));
+    }
+    else {
+        hashtable_top_k_buckets(hashtable->table, hashtable->size, keys,
+                                counts, k, &n);
+        if (hashtable->rehash_table != NULL)
+            hashtable_top_k_buckets(hashtable->rehash_table,
+                                    hashtable->rehash_size, keys, counts, k,
+                                    &n);
+    }
+
+    // Heap sort: the smallest counter goes to the end every time
+    for (i = n; i > 1; i--) {
+        key = keys[0];
+        count = counts[0];
+        keys[0] = keys[i - 1];
+        counts[0] = counts[i - 1];
+        keys[i - 1] = key;
+        counts[i - 1] = count;
+        hashtable_heap_down(keys, counts, i - 1, 0);
+    }
+
+    return n;
+}
+
+
+/**** BULK BUILD FUNCTIONS ****************************************************/
+
+/*
+ * State of a bulk build shared by all workers. Keys are counting-sorted by
+ * partition (a range of buckets per worker) into "order", keeping the input
+ * order inside every partition, so every worker links the nodes of its own
+ * buckets without locks.
+ */
+struct hashbuild_s {
+    hashtable_t *hashtable;
+    void **keys;
+    void **values;
+    unsigned long n;
+    int unique_keys;
+    unsigned int workers;
+    unsigned long partition_size;
+    unsigned long *hashes;
+    unsigned long *positions;
+    unsigned long *order;
+    unsigned long *histogram;
+    hashnode_t *nodes;
+};
+
+struct hashbuild_worker_s {
+    struct hashbuild_s *build;
+    unsigned int id;
+    int phase;
+    unsigned long count;
+    hashnode_t *unused;
+    int error;
+};
+
+typedef struct hashbuild_s hashbuild_t;
+typedef struct hashbuild_worker_s hashbuild_worker_t;
+
+/*
+ * Runs one phase of a bulk build for one worker:
+ * Phase 0: hashes its range of input keys and counts them by partition.
+ * Phase 1: writes the indexes of its range of input keys into "order".
+ * Phase 2: links the keys of its partition into their buckets.
+ */
+static void *hashtable_build_worker(void *arg) {
+
+    hashbuild_worker_t *worker = (hashbuild_worker_t *) arg;
+    hashbuild_t *build = worker->build;
+    hashtable_t *hashtable = build->hashtable;
+    unsigned long *histogram = build->histogram + worker->id * build->workers;
+    unsigned long first, last, i, k;
+    unsigned long partition;
+    hashnode_t *node = NULL;
+
+    if (worker->phase < 2) {
+        first = build->n / build->workers * worker->id;
+        last = worker->id + 1 == build->workers
+               ? build->n : first + build->n / build->workers;
+
+        for (i = first; i < last; i++) {
+            if (worker->phase == 0) {
+                build->hashes[i] = hashtable_hash_key(hashtable,
+                                                      build->keys[i]);
+                build->positions[i] = hashtable_calculate_key_position(
+                                          hashtable, build->hashes[i],
+                                          hashtable->size);
+                histogram[build->positions[i] / build->partition_size]++;
+            }
+            else {
+                partition = build->positions[i] / build->partition_size;
+                build->order[histogram[partition]++] = i;
+            }
+        }
+        return NULL;
+    }
+
+    // Phase 2, "histogram" now holds where every partition starts and ends
+    first = worker->id == 0 ? 0 : build->histogram[worker->id - 1];
+    last = build->histogram[worker->id];
+
+    for (k = first; k < last; k++) {
+        i = build->order[k];
+
+        if (!build->unique_keys) {
+            for (node = hashtable->table[build->positions[i]]; node != NULL;
+                 node = node->next)
+                if (node->hash == build->hashes[i] &&
+                    hashtable->compare(build->keys[i], node->key) == 0)
+                    break;
+
+            if (node != NULL) {
+                if (hashtable->value_delete != NULL)
+                    hashtable->value_delete(node->value);
+                node->value = build->values != NULL ? build->values[i] : NULL;
+                if (build->nodes != NULL) {
+                    build->nodes[k].next = worker->unused;
+                    worker->unused = &build->nodes[k];
+                }
+                continue;
+            }
+        }
+
+        if (build->nodes != NULL) {
+            node = &build->nodes[k];
+        }
+        else {
+            node = (hashnode_t *) hashtable_alloc(hashtable,
+                                                  sizeof(hashnode_t));
+            if (node == NULL) {
+                worker->error = 1;
+                return NULL;
+            }
+        }
+
+        node->key = build->keys[i];
+        node->value = build->values != NULL ? build->values[i] : NULL;
+        node->hash = build->hashes[i];
+        node->next = hashtable->table[build->positions[i]];
+        hashtable->table[build->positions[i]] = node;
+        worker->count++;
+    }
+
+    return NULL;
+}
+
+/*
+ * Links all keys into the buckets of an empty chained table with
+ * "workers" threads.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_build_chained(hashtable_t *hashtable, void **keys,
+                                   void **values, unsigned long n,
+                                   int unique_keys, unsigned int workers) {
+
+    hashbuild_t build;
+    hashbuild_worker_t *worker = NULL;
+    hashslab_t *slab = NULL;
+    hashnode_t *node = NULL;
+    unsigned long total, partition_total;
+    unsigned long w, p;
+    int result = 0;
+
+    if (workers > HASHTABLE_MAX_THREADS)
+        workers = HASHTABLE_MAX_THREADS;
+    if (workers > n / 1024 + 1)
+        workers = n / 1024 + 1;
+    if (workers > hashtable->size)
+        workers = hashtable->size;
+
+    build.hashtable = hashtable;
+    build.keys = keys;
+    build.values = values;
+    build.n = n;
+    build.unique_keys = unique_keys;
+    build.workers = workers;
+    build.partition_size = (hashtable->size + workers - 1) / workers;
+    build.hashes = (unsigned long *) hashtable_alloc(hashtable,
+                                                     n * sizeof(unsigned long));
+    build.positions = (unsigned long *) hashtable_alloc(hashtable,
+                                                     n * sizeof(unsigned long));
+    build.order = (unsigned long *) hashtable_alloc(hashtable,
+                                                    n * sizeof(unsigned long));
+    build.histogram = (unsigned long *) calloc (workers * workers,
+                                                sizeof(unsigned long));
+    build.nodes = NULL;
+    worker = (hashbuild_worker_t *) calloc (workers,
+                                            sizeof(hashbuild_worker_t));
+
+    // Pooled tables get all nodes in one slab
+    if (hashtable->slab_size > 0) {
+        slab = (hashslab_t *) hashtable_alloc(hashtable,
+                                              sizeof(hashslab_t) +
+                                              n * sizeof(hashnode_t));
+        if (slab != NULL) {
+            slab->size = n;
+            build.nodes = slab->nodes;
+        }
+    }
+
+    if (build.hashes == NULL || build.positions == NULL ||
+        build.order == NULL || build.histogram == NULL || worker == NULL ||
+        (hashtable->slab_size > 0 && slab == NULL)) {
+        result = -1;
+        goto end;
+    }
+
+    for (w = 0; w < workers; w++) {
+        worker[w].build = &build;
+        worker[w].id = w;
+    }
+
+    hashtable_run_workers(hashtable_build_worker, worker,
+                          sizeof(hashbuild_worker_t), workers);
+
+    // Histogram to first position of every (worker, partition) in "order"
+    total = 0;
+    for (p = 0; p < workers; p++) {
+        for (w = 0; w < workers; w++) {
+            partition_total = build.histogram[w * workers + p];
+            build.histogram[w * workers + p] = total;
+            total += partition_total;
+        }
+    }
+
+    for (w = 0; w < workers; w++)
+        worker[w].phase = 1;
+    hashtable_run_workers(hashtable_build_worker, worker,
+                          sizeof(hashbuild_worker_t), workers);
+
+    // After phase 1 the last worker's counters are the partition ends
+    for (p = 0; p < workers; p++)
+        build.histogram[p] = build.histogram[(workers - 1) * workers + p];
+
+    for (w = 0; w < workers; w++)
+        worker[w].phase = 2;
+    hashtable_run_workers(hashtable_build_worker, worker,
+                          sizeof(hashbuild_worker_t), workers);
+
+    for (w = 0; w < workers; w++) {
+        hashtable->count += worker[w].count;
+        if (worker[w].error)
+            result = -1;
+        while ((node = worker[w].unused) != NULL) {
+            worker[w].unused = node->next;
+            hashtable_node_delete(hashtable, node);
+        }
+    }
+
+    if (slab != NULL) {
+        slab->next = hashtable->slabs;
+        hashtable->slabs = slab;
+        hashtable->slab_used = slab->size;
+        slab = NULL;
+    }
+
+end:
+    if (slab != NULL)
+        hashtable_free(hashtable, slab,
+                       sizeof(hashslab_t) + n * sizeof(hashnode_t));
+    hashtable_free(hashtable, build.hashes, n * sizeof(unsigned long));
+    hashtable_free(hashtable, build.positions, n * sizeof(unsigned long));
+    hashtable_free(hashtable, build.order, n * sizeof(unsigned long));
+    free(build.histogram);
+    free(worker);
+
+    return result;
+}
+
+/*
+ * Creates a hash table with "n" key-value pairs (keys[i], values[i]).
+ * Return: NULL if error, pointer to hashtable on success.
+ */
+hashtable_t *hashtable_build_from_arrays(void **keys, void **values,
+                                         unsigned long n, int unique_keys,
+                                         fp_compare_keys compare_function,
+                                         fp_hashvalue hashvalue_function,
+                                         fp_delete key_delete_function,
+                                         fp_delete value_delete_function,
+                                         const hashtable_options_t *options) {
+
+    hashtable_t *hashtable = NULL;
+    hashtable_options_t defaults;
+    unsigned long size;
+    unsigned long i;
+    float load_factor;
+
+    if (keys == NULL)
+        return NULL;
+
+    for (i = 0; i < n; i++)
+        if (keys[i] == NULL)
+            return NULL;
+
+    if (options == NULL) {
+        hashtable_options_init(&defaults);
+        options = &defaults;
+    }
+
+    load_factor = options->max_load_factor > 0 ? options->max_load_factor
+                                               : 1.0f;
+    size = (unsigned long) (n / load_factor) + 1;
+    if (options->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING)
+        size = size / HASHTABLE_OA_MAX_LOAD_EIGHTHS * 8 + 1;
+
+    hashtable = hashtable_create_with_options(size, compare_function,
+                                              hashvalue_function,
+                                              key_delete_function,
+                                              value_delete_function, options);
+    if (hashtable == NULL)
+        return NULL;
+
+    // The arena is not shared by threads, interned keys are inserted in order
+    if (hashtable->backend == HASHTABLE_BACKEND_CHAINED &&
+        !hashtable->intern_keys && !hashtable->intern_values) {
+        if (hashtable_build_chained(hashtable, keys, values, n, unique_keys,
+                                    options->threads > 0 ? options->threads
+                                                         : 1) == 0)
+            return hashtable;
+    }
+    else {
+        // Probe sequences cross any partition, keys are inserted in order
+        for (i = 0; i < n; i++)
+            if (hashtable_set(hashtable, keys[i],
+                              values != NULL ? values[i] : NULL) != 0)
+                break;
+        if (i == n)
+            return hashtable;
+    }
+
+    // The caller keeps the ownership of keys and values
+    hashtable->key_delete = NULL;
+    hashtable->value_delete = NULL;
+    hashtable_delete(hashtable);
+
+    return NULL;
+}
+
+
+/**** MERGE FUNCTIONS *********************************************************/
+
+/*
+ * State of a parallel merge shared by all workers. Every worker owns a range
+ * of buckets of the destination table (a partition) and a range of buckets
+ * of every shard. Nodes go from the shards to "lists", a list per (worker,
+ * partition), and from there to the buckets of their partition, so no two
+ * workers ever touch the same list or bucket.
+ */
+struct hashmerge_s {
+    hashtable_t *hashtable;
+    hashtable_t **shards;
+    unsigned long n;
+    fp_combine combine;
+    unsigned int workers;
+    unsigned long partition_size;
+    hashnode_t **lists;
+};
+
+struct hashmerge_worker_s {
+    struct hashmerge_s *merge;
+    unsigned int id;
+    int phase;
+    unsigned long count;
+    hashnode_t *unused;
+};
+
+typedef struct hashmerge_s hashmerge_t;
+typedef struct hashmerge_worker_s hashmerge_worker_t;
+
+/*
+ * Return: 1 if both tables hash keys the same way, so hash values stored by
+ * one are valid in the other, 0 if not.
+ */
+static int hashtable_same_hash(hashtable_t *hashtable, hashtable_t *source) {
+
+    if (hashtable->hashvalue_seeded != NULL)
+        return hashtable->hashvalue_seeded == source->hashvalue_seeded &&
+               hashtable->seed == source->seed;
+
+    return source->hashvalue_seeded == NULL &&
+           hashtable->hashvalue == source->hashvalue;
+}
+
+/*
+ * Return: 1 if the nodes of "source" can be linked into a table as they
+ * are, 0 if not: both tables must be chained with the same allocator, and
+ * both or neither must have a node pool.
+ */
+static int hashtable_merge_moves_nodes(hashtable_t *hashtable,
+                                       hashtable_t *source) {
+
+    return hashtable->backend == HASHTABLE_BACKEND_CHAINED &&
+           source->backend == HASHTABLE_BACKEND_CHAINED &&
+           (hashtable->slab_size > 0) == (source->slab_size > 0) &&
+           hashtable_same_allocator(hashtable, source);
+}
+
+/*
+ * Stores "value" as the value of a key already in a table, combining it
+ * with the current one if "combine" is not NULL.
+ */
+static void hashtable_merge_value(hashtable_t *hashtable, void **slot,
+                                  void *value, fp_combine combine) {
+
+    if (combine != NULL) {
+        *slot = combine(*slot, value);
+        return;
+    }
+
+    if (hashtable->value_delete != NULL && *slot != value)
+        hashtable->value_delete(*slot);
+    *slot = value;
+}
+
+/*
+ * Links a node of another table into a chained table, or combines its value
+ * with the one of its key if the table has it, releasing the node and
+ * freeing its key. "node->hash" must be the hash value of the table.
+ */
+static void hashtable_merge_node(hashtable_t *hashtable, hashnode_t *node,
+                                 fp_combine combine) {
+
+    hashnode_t **bucket = NULL;
+    hashnode_t *found = NULL;
+    size_t length;
+
+    hashtable_rehash_step(hashtable, hashtable->rehash_step);
+
+    bucket = hashtable_bucket(hashtable, node->hash);
+    length = hashtable->intern_keys ? hashtable_arena_length(node->key) : 0;
+
+    for (found = *bucket; found != NULL; found = found->next)
+        if (found->hash == node->hash &&
+            hashtable_key_equal(hashtable, node->key, length, found->key))
+            break;
+
+    if (found != NULL) {
+        hashtable_merge_value(hashtable, &found->value, node->value, combine);
+        if (hashtable->key_delete != NULL)
+            hashtable->key_delete(node->key);
+        hashtable_node_delete(hashtable, node);
+        return;
+    }
+
+    node->next = *bucket;
+    *bucket = node;
+    hashtable->count++;
+
+    hashtable_check_load(hashtable);
+}
+
+/*
+ * Introduces a key-value pair of "source" into a table that cannot take its
+ * node, allocating a node or a slot for it. A key already in the table is
+ * freed with the key delete function of "source".
+ * Return: 0 on success, -1 on error (the pair stays in "source").
+ */
+static int hashtable_merge_pair(hashtable_t *hashtable, hashtable_t *source,
+                                void *key, void *value, unsigned long hash,
+                                fp_combine combine) {
+
+    void **slot = NULL;
+    int inserted;
+
+    slot = hashtable_upsert_hashed(hashtable, key, hash, &inserted);
+    if (slot == NULL)
+        return -1;
+
+    if (inserted) {
+        *slot = value;
+    }
+    else {
+        if (source->key_delete != NULL)
+            source->key_delete(key);
+        hashtable_merge_value(hashtable, slot, value, combine);
+    }
+
+    if (hashtable->charges != NULL)
+        hashtable_cache_charge_slot(hashtable,
+                                    hashtable_oa_slot(hashtable, slot));
+
+    return 0;
+}
+
+/*
+ * Moves all key-value pairs of a table into another one.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_merge(hashtable_t *hashtable, hashtable_t *source,
+                    fp_combine combine) {
+
+    hashnode_t *node = NULL;
+    unsigned long hash;
+    unsigned long i;
+    int same_hash, move;
+
+    if (hashtable == NULL || source == NULL || hashtable == source)
+        return -1;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_MAPPED ||
+        source->backend == HASHTABLE_BACKEND_MAPPED)
+        return -1;
+
+    if (hashtable->iterators > 0 || source->iterators > 0)
+        return -1;
+
+    // Interned copies are moved, never copied or freed one by one
+    if (hashtable->intern_keys != source->intern_keys ||
+        hashtable->intern_values != source->intern_values ||
+        (source->arena != NULL &&
+         !hashtable_same_allocator(hashtable, source)))
+        return -1;
+
+    // A failed reserve only means that the table grows while merging
+    hashtable_reserve(hashtable, hashtable->count + source->count);
+    hashtable_arena_adopt(hashtable, source);
+
+    if (source->backend == HASHTABLE_BACKEND_OPEN_ADDRESSING) {
+        for (i = 0; i < source->size; i++) {
+            if (source->ctrl[i] < 0)
+                continue;
+            if (hashtable_oa_expired(source, i)) {
+                hashtable_oa_expire_slot(source, i);
+                continue;
+            }
+            if (hashtable_merge_pair(hashtable, source,
+                                     source->slots[i].key,
+                                     source->slots[i].value,
+                                     hashtable_hash_key(hashtable,
+                                                        source->slots[i].key),
+                                     combine) != 0)
+                return -1;
+            hashtable_oa_erase(source, i);
+        }
+        return 0;
+    }
+
+    // A chained source ends its resize, so its nodes are in one array
+    hashtable_rehash_step(source, source->size);
+
+    same_hash = hashtable_same_hash(hashtable, source);
+    move = hashtable_merge_moves_nodes(hashtable, source);
+    if (move && hashtable->slab_size > 0)
+        hashtable_pool_adopt(hashtable, source);
+
+    for (i = 0; i < source->size; i++) {
+        while ((node = source->table[i]) != NULL) {
+            hash = same_hash ? node->hash
+                             : hashtable_hash_key(hashtable, node->key);
+            if (move) {
+                source->table[i] = node->next;
+                source->count--;
+                node->hash = hash;
+                hashtable_merge_node(hashtable, node, combine);
+                continue;
+            }
+            if (hashtable_merge_pair(hashtable, source, node->key,
+                                     node->value, hash, combine) != 0)
+                return -1;
+            source->table[i] = node->next;
+            source->count--;
+            hashtable_node_delete(source, node);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Runs one phase of a parallel merge for one worker:
+ * Phase 0: takes the nodes of its range of buckets of every shard and sorts
+ * them by partition of the destination table.
+ * Phase 1: links the nodes sorted into its partition into their buckets.
+ */
+static void *hashtable_merge_worker(void *arg) {
+
+    hashmerge_worker_t *worker = (hashmerge_worker_t *) arg;
+    hashmerge_t *merge = worker->merge;
+    hashtable_t *hashtable = merge->hashtable;
+    hashtable_t *shard = NULL;
+    hashnode_t **bucket = NULL;
+    hashnode_t *node = NULL;
+    hashnode_t *next = NULL;
+    hashnode_t *found = NULL;
+    unsigned long first, last, i, s;
+    unsigned long partition;
+    unsigned int w;
+    size_t length;
+    int same_hash;
+
+    if (worker->phase == 0) {
+        for (s = 0; s < merge->n; s++) {
+            shard = merge->shards[s];
+            same_hash = hashtable_same_hash(hashtable, shard);
+            first = shard->size / merge->workers * worker->id;
+            last = worker->id + 1 == merge->workers
+                   ? shard->size : first + shard->size / merge->workers;
+
+            for (i = first; i < last; i++) {
+                for (node = shard->table[i]; node != NULL; node = next) {
+                    next = node->next;
+                    if (!same_hash)
+                        node->hash = hashtable_hash_key(hashtable, node->key);
+                    partition = hashtable_calculate_key_position(
+                                    hashtable, node->hash, hashtable->size) /
+                                merge->partition_size;
+                    node->next = merge->lists[worker->id * merge->workers +
+                                              partition];
+                    merge->lists[worker->id * merge->workers + partition] =
+                        node;
+                }
+                shard->table[i] = NULL;
+            }
+        }
+        return NULL;
+    }
+
+    for (w = 0; w < merge->workers; w++) {
+        node = merge->lists[w * merge->workers + worker->id];
+
+        for (; node != NULL; node = next) {
+            next = node->next;
+            bucket = &hashtable->table[hashtable_calculate_key_position(
+                                           hashtable, node->hash,
+                                           hashtable->size)];
+            length = hashtable->intern_keys
+                     ? hashtable_arena_length(node->key) : 0;
+
+            for (found = *bucket; found != NULL; found = found->next)
+                if (found->hash == node->hash &&
+                    hashtable_key_equal(hashtable, node->key, length,
+                                        found->key))
+                    break;
+
+            if (found != NULL) {
+                hashtable_merge_value(hashtable, &found->value, node->value,
+                                      merge->combine);
+                if (hashtable->key_delete != NULL)
+                    hashtable->key_delete(node->key);
+                node->next = worker->unused;
+                worker->unused = node;
+                continue;
+            }
+
+            node->next = *bucket;
+            *bucket = node;
+            worker->count++;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Moves all key-value pairs of "n" shards into a table.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_merge_shards(hashtable_t *hashtable, hashtable_t **shards,
+                           unsigned long n, fp_combine combine) {
+
+    hashmerge_t merge;
+    hashmerge_worker_t *worker = NULL;
+    hashnode_t *node = NULL;
+    unsigned long total;
+    unsigned long s;
+    unsigned int workers, w;
+    int parallel;
+
+    if (hashtable == NULL || (shards == NULL && n > 0))
+        return -1;
+
+    merge.lists = NULL;
+
+    total = hashtable->count;
+    parallel = hashtable->backend == HASHTABLE_BACKEND_CHAINED &&
+               hashtable->iterators == 0;
+    for (s = 0; s < n; s++) {
+        if (shards[s] == NULL || shards[s] == hashtable)
+            return -1;
+        total += shards[s]->count;
+        if (!hashtable_merge_moves_nodes(hashtable, shards[s]) ||
+            shards[s]->iterators > 0 ||
+            shards[s]->intern_keys != hashtable->intern_keys ||
+            shards[s]->intern_values != hashtable->intern_values)
+            parallel = 0;
+    }
+
+    workers = hashtable->threads;
+    if (workers > HASHTABLE_MAX_THREADS)
+        workers = HASHTABLE_MAX_THREADS;
+    if (workers > total / 1024 + 1)
+        workers = total / 1024 + 1;
+
+    // The partitions need the final bucket array, with no resize in progress
+    if (parallel && workers > 1 && hashtable_reserve(hashtable, total) == 0 &&
+        hashtable->rehash_table == NULL) {
+        if (workers > hashtable->size)
+            workers = hashtable->size;
+        merge.lists = (hashnode_t **) calloc (workers * workers,
+                                              sizeof(hashnode_t*));
+        worker = (hashmerge_worker_t *) calloc (workers,
+                                                sizeof(hashmerge_worker_t));
+    }
+
+    if (worker == NULL || merge.lists == NULL) {
+        free(merge.lists);
+        free(worker);
+        for (s = 0; s < n; s++)
+            if (hashtable_merge(hashtable, shards[s], combine) != 0)
+                return -1;
+        return 0;
+    }
+
+    merge.hashtable = hashtable;
+    merge.shards = shards;
+    merge.n = n;
+    merge.combine = combine;
+    merge.workers = workers;
+    merge.partition_size = (hashtable->size + workers - 1) / workers;
+
+    // Shards end their resizes and give their memory to the table
+    for (s = 0; s < n; s++) {
+        hashtable_rehash_step(shards[s], shards[s]->size);
+        hashtable_arena_adopt(hashtable, shards[s]);
+        if (hashtable->slab_size > 0)
+            hashtable_pool_adopt(hashtable, shards[s]);
+    }
+
+    for (w = 0; w < workers; w++) {
+        worker[w].merge = &merge;
+        worker[w].id = w;
+    }
+
+    hashtable_run_workers(hashtable_merge_worker, worker,
+                          sizeof(hashmerge_worker_t), workers);
+
+    for (w = 0; w < workers; w++)
+        worker[w].phase = 1;
+    hashtable_run_workers(hashtable_merge_worker, worker,
+                          sizeof(hashmerge_worker_t), workers);
+
+    for (s = 0; s < n; s++)
+        shards[s]->count = 0;
+
+    for (w = 0; w < workers; w++) {
+        hashtable->count += worker[w].count;
+        while ((node = worker[w].unused) != NULL) {
+            worker[w].unused = node->next;
+            hashtable_node_delete(hashtable, node);
+        }
+    }
+
+    free(merge.lists);
+    free(worker);
+
+    return 0;
+}
+
+/*
+ * Frees "n" tables and the array that holds them.
+ */
+void hashtable_delete_shards(hashtable_t **shards, unsigned long n) {
+
+    unsigned long i;
+
+    if (shards == NULL)
+        return;
+
+    for (i = 0; i < n; i++)
+        hashtable_delete(shards[i]);
+
+    free(shards);
+}
+
+/*
+ * Creates "n" tables with the same parameters and seed.
+ * Return: NULL if error, array of tables on success.
+ */
+hashtable_t **hashtable_create_shards(unsigned long n, unsigned long size,
+                                      fp_compare_keys compare_function,
+                                      fp_hashvalue hashvalue_function,
+                                      fp_delete key_delete_function,
+                                      fp_delete value_delete_function,
+                                      const hashtable_options_t *options) {
+
+    hashtable_t **shards = NULL;
+    hashtable_options_t shard_options;
+    unsigned long i;
+
+    if (n == 0)
+        return NULL;
+
+    if (options != NULL)
+        shard_options = *options;
+    else
+        hashtable_options_init(&shard_options);
+
+    // A common seed lets the merge keep the hash values of the nodes
+    if (shard_options.seed == 0)
+        shard_options.seed = (unsigned long) hashtable_table_seed();
+
+    shards = (hashtable_t **) calloc (n, sizeof(hashtable_t*));
+    if (shards == NULL)
+        return NULL;
+
+    for (i = 0; i < n; i++) {
+        shards[i] = hashtable_create_with_options(size, compare_function,
+                                                  hashvalue_function,
+                                                  key_delete_function,
+                                                  value_delete_function,
+                                                  &shard_options);
+        if (shards[i] == NULL) {
+            hashtable_delete_shards(shards, i);
+            return NULL;
+        }
+    }
+
+    return shards;
+}
+
+
+/**** SNAPSHOT FUNCTIONS ******************************************************/
+
+/*
+ * Key or value of a table with its hash, collected to be saved.
+ */
+struct hashsnapshot_item_s {
+    void *key;
+    void *value;
+    unsigned long hash;
+    unsigned long position;
+};
+
+typedef struct hashsnapshot_item_s hashsnapshot_item_t;
+
+/*
+ * Writes "length" bytes and the zeros needed to pad them to 8 bytes.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_write_padded(FILE *file, const void *data,
+                                  uint64_t length) {
+
+    static const char zeros[8] = {0};
+
+    if (length > 0 && fwrite(data, 1, length, file) != length)
+        return -1;
+    if (length % 8 != 0 && fwrite(zeros, 1, 8 - length % 8, file) !=
+                           8 - length % 8)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Collects all key-value pairs of a table with their hash value, sorted by
+ * their bucket in a bucket array of "size" buckets.
+ * Return: Array of hashtable->count items, NULL on error.
+ */
+static hashsnapshot_item_t *hashtable_snapshot_items(hashtable_t *hashtable,
+                                                     unsigned long size) {
+
+    hashsnapshot_item_t *items = NULL;
+    hashsnapshot_item_t *sorted = NULL;
+    unsigned long *starts = NULL;
+    hashtable_iterator_t iterator;
+    hashnode_t *node = NULL;
+    hashnode_t **table = NULL;
+    unsigned long table_size, i, n = 0;
+    int phase;
+
+    items = (hashsnapshot_item_t *) malloc ((hashtable->count + 1) *
+                                            sizeof(hashsnapshot_item_t));
+    sorted = (hashsnapshot_item_t *) malloc ((hashtable->count + 1) *
+                                             sizeof(hashsnapshot_item_t));
+    starts = (unsigned long *) calloc (size + 1, sizeof(unsigned long));
+    if (items == NULL || sorted == NULL || starts == NULL)
+        goto error;
+
+    if (hashtable->backend == HASHTABLE_BACKEND_CHAINED) {
+        // Nodes know their hash, no need to hash the keys again
+        for (phase = 0; phase < 2; phase++) {
+            table = phase == 0 ? hashtable->table : hashtable->rehash_table;
+            table_size = phase == 0 ? hashtable->size : hashtable->rehash_size;
+            for (i = 0; table != NULL && i < table_size; i++) {
+                for (node = table[i]; node != NULL; node = node->next) {
+                    items[n].key = node->key;
+                    items[n].value = node->value;
+                    items[n].hash = node->hash;
+                    n++;
+                }
+            }
+        }
+    }
+    else {
+        hashtable_iterator_init(hashtable, &iterator);
+        while (n < hashtable->count &&
+               hashtable_iterator_next(&iterator, &items[n].key,
+                                       &items[n].value)) {
+            items[n].hash = hashtable_hash_key(hashtable, items[n].key);
+            n++;
+        }
+        hashtable_iterator_release(&iterator);
+    }
+
+    // Counting sort by bucket
+    for (i = 0; i < n; i++) {
+        items[i].position = hashtable_calculate_key_position(hashtable,
+                                                             items[i].hash,
+                                                             size);
+        starts[items[i].position + 1]++;
+    }
+    for (i = 0; i < size; i++)
+        starts[i + 1] += starts[i];
+    for (i = 0; i < n; i++)
+        sorted[starts[items[i].position]++] = items[i];
+
+    free(items);
+    free(starts);
+    return sorted;
+
+error:
+    free(items);
+    free(sorted);
+    free(starts);
+    return NULL;
+}
+
+/*
+ * Syncs the directory of the file at "path", so a file created or renamed
+ * in it survives a crash of the system. "path" is modified.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_sync_directory(char *path) {
+
+    char *slash = strrchr(path, '/');
+    int fd;
+    int result;
+
+    if (slash == NULL)
+        strcpy(path, ".");
+    else if (slash == path)
+        path[1] = '\0';
+    else
+        *slash = '\0';
+
+    fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return -1;
+
+    result = fsync(fd);
+    close(fd);
+
+    return result;
+}
+
+/*
+ * Saves a table to a snapshot file that hashtable_open_mapped() can map.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_save(hashtable_t *hashtable, const char *path,
+                   fp_length key_length_function,
+                   fp_length value_length_function) {
+
+    hashsnapshot_header_t header;
+    hashsnapshot_entry_t entry;
+    hashsnapshot_item_t *items = NULL;
+    uint64_t *buckets = NULL;
+    uint64_t offset;
+    unsigned long size, i;
+    char *temporary_path = NULL;
+    FILE *file = NULL;
+    int result;
+
+    if (hashtable == NULL || path == NULL ||
+        hashtable->backend == HASHTABLE_BACKEND_MAPPED)
+        return -1;
+
+    if (key_length_function == NULL)
+        key_length_function = hashtable->intern_keys ? hashtable->key_length
+                                                     : hashtable_string_length;
+    if (value_length_function == NULL)
+        value_length_function = hashtable_string_length;
+
+    // A table in the middle of a resize is saved with its final size
+    size = hashtable->rehash_table != NULL ? hashtable->rehash_size
+                                           : hashtable->size;
+
+    items = hashtable_snapshot_items(hashtable, size);
+    buckets = (uint64_t *) calloc (size, sizeof(uint64_t));
+    temporary_path = (char *) malloc (strlen(path) + 5);
+    if (items == NULL || buckets == NULL || temporary_path == NULL)
+        goto error;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HASHSNAPSHOT_MAGIC, sizeof(header.magic));
+    header.byte_order = HASHSNAPSHOT_BYTE_ORDER;
+    header.flags = hashtable->exact_size ? HASHSNAPSHOT_EXACT_SIZE : 0;
+    header.seed = hashtable->seed;
+    header.count = hashtable->count;
+    header.size = size;
+    header.buckets = sizeof(header);
+
+    // Entries of a bucket are written one after another
+    offset = header.buckets + size * sizeof(uint64_t);
+    for (i = 0; i < hashtable->count; i++) {
+        if (i == 0 || items[i].position != items[i - 1].position)
+            buckets[items[i].position] = offset;
+        offset += sizeof(entry) +
+                  (key_length_function(items[i].key) + 7) / 8 * 8;
+        if (items[i].value != NULL)
+            offset += (value_length_function(items[i].value) + 7) / 8 * 8;
+    }
+    header.file_size = offset;
+
+    // Written to a temporary file and renamed, so a crash never leaves a
+    // partial snapshot at "path"
+    sprintf(temporary_path, "%s.tmp", path);
+    file = fopen(temporary_path, "wb");
+    if (file == NULL)
+        goto error;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        (size > 0 && fwrite(buckets, sizeof(uint64_t), size, file) != size))
+        goto error;
+
+    offset = header.buckets + size * sizeof(uint64_t);
+    for (i = 0; i < hashtable->count; i++) {
+        entry.hash = items[i].hash;
+        entry.key_length = key_length_function(items[i].key);
+        entry.value_length = items[i].value != NULL
+                             ? value_length_function(items[i].value)
+                             : HASHSNAPSHOT_NULL_VALUE;
+        offset += sizeof(entry) + (entry.key_length + 7) / 8 * 8;
+        if (items[i].value != NULL)
+            offset += (entry.value_length + 7) / 8 * 8;
+        entry.next = i + 1 < hashtable->count &&
+                     items[i + 1].position == items[i].position ? offset : 0;
+
+        if (fwrite(&entry, sizeof(entry), 1, file) != 1 ||
+            hashtable_write_padded(file, items[i].key,
+                                   entry.key_length) != 0 ||
+            (items[i].value != NULL &&
+             hashtable_write_padded(file, items[i].value,
+                                    entry.value_length) != 0))
+            goto error;
+    }
+
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0)
+        goto error;
+    if (fclose(file) != 0) {
+        file = NULL;
+        goto error;
+    }
+    file = NULL;
+
+    if (rename(temporary_path, path) != 0)
+        goto error;
+
+    // The rename is only durable once the directory is synced, and the
+    // temporary path is reused for the directory
+    strcpy(temporary_path, path);
+    result = hashtable_sync_directory(temporary_path);
+
+    free(items);
+    free(buckets);
+    free(temporary_path);
+    return result;
+
+error:
+    if (file != NULL)
+        fclose(file);
+    if (temporary_path != NULL)
+        remove(temporary_path);
+    free(items);
+    free(buckets);
+    free(temporary_path);
+    return -1;
+}
+
+/*
+ * Opens a snapshot file saved with hashtable_save() as a read-only table.
+ * Return: NULL if error, pointer to hashtable on success.
+ */
+hashtable_t *hashtable_open_mapped(const char *path,
+                                   fp_compare_keys compare_function,
+                                   fp_hashvalue hashvalue_function,
+                                   const hashtable_options_t *options) {
+
+    hashtable_t *hashtable = NULL;
+    hashsnapshot_header_t *header = NULL;
+    hashtable_options_t defaults;
+    struct stat st;
+    void *map = MAP_FAILED;
+    int fd = -1;
+
+    if (options == NULL) {
+        hashtable_options_init(&defaults);
+        options = &defaults;
+    }
+
+    if (path == NULL || compare_function == NULL ||
+        (hashvalue_function == NULL && options->hashvalue_seeded == NULL))
+        return NULL;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*header))
+        goto error;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        goto error;
+    close(fd);
+    fd = -1;
+
+    // Lookups jump around the file, read ahead would be wasted
+    madvise(map, st.st_size, MADV_RANDOM);
+
+    header = (hashsnapshot_header_t *) map;
+    if (memcmp(header->magic, HASHSNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->byte_order != HASHSNAPSHOT_BYTE_ORDER ||
+        header->file_size != (uint64_t) st.st_size || header->size == 0 ||
+        header->buckets != sizeof(*header) ||
+        header->size > (header->file_size - header->buckets) / 8)
+        goto error;
+
+    hashtable = (hashtable_t *) calloc (1, sizeof(hashtable_t));
+    if (hashtable == NULL)
+        goto error;
+
+    hashtable->allocator = hashtable_default_allocator;
+    hashtable->backend = HASHTABLE_BACKEND_MAPPED;
+    hashtable->size = header->size;
+    hashtable->count = header->count;
+    hashtable->min_size = header->size;
+    hashtable->exact_size = (header->flags & HASHSNAPSHOT_EXACT_SIZE) != 0;
+    hashtable->map = (unsigned char *) map;
+    hashtable->map_size = st.st_size;
+    hashtable->compare = compare_function;
+    hashtable->hashvalue = hashvalue_function;
+    hashtable->hashvalue_seeded = options->hashvalue_seeded;
+    hashtable->seed = header->seed;
+    hashtable->counters = options->counters;
+    hashtable_reset_counters(hashtable);
+
+    return hashtable;
+
+error:
+    if (map != MAP_FAILED)
+        munmap(map, st.st_size);
+    if (fd >= 0)
+        close(fd);
+    return NULL;
+}
+
+
+/**** INTEGER KEY TABLE FUNCTIONS *********************************************/
+
+/*
+ * Allocates the control bytes and slots of an integer key table with "size"
+ * slots (a power of two multiple of HASHTABLE_GROUP_WIDTH).
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_u64_alloc(hashtable_u64_t *hashtable,
+                               unsigned long size) {
+
+    signed char *ctrl = NULL;
+
+    ctrl = (signed char *) malloc (size + size * sizeof(hashslot_u64_t));
+    if (ctrl == NULL)
+        return -1;
+
+    memset(ctrl, HASHTABLE_CTRL_EMPTY, size);
+
+    hashtable->ctrl = ctrl;
+    hashtable->slots = (hashslot_u64_t *) (ctrl + size);
+    hashtable->size = size;
+    hashtable->tombstones = 0;
+
+    return 0;
+}
+
+/*
+ * Finds the slot of a key, "mixed" being its mixed hash value.
+ * Return: Slot index, or the number of slots if the key is not in the table.
+ */
+static unsigned long hashtable_u64_find(hashtable_u64_t *hashtable,
+                                        uint64_t key, uint64_t mixed) {
+
+    signed char h2 = hashgroup_h2(mixed);
+    hashprobe_t probe;
+    unsigned long slot;
+    unsigned int mask;
+    const signed char *ctrl;
+
+    hashprobe_start(&probe, mixed, hashtable->size);
+    do {
+        ctrl = hashtable->ctrl + probe.offset;
+
+        for (mask = hashgroup_match(ctrl, h2); mask != 0; mask &= mask - 1) {
+            slot = probe.offset + hashgroup_first(mask);
+            if (hashtable->slots[slot].key == key)
+                return slot;
+        }
+
+        if (hashgroup_match(ctrl, HASHTABLE_CTRL_EMPTY) != 0)
+            break;
+    } while (hashprobe_next(&probe));
+
+    return hashtable->size;
+}
+
+/*
+ * Finds a free slot for a key that is not in the table and marks it as used.
+ * The table must have at least one free slot.
+ * Return: Slot index.
+ */
+static unsigned long hashtable_u64_claim(hashtable_u64_t *hashtable,
+                                         uint64_t mixed) {
+
+    return hashgroup_claim(hashtable->ctrl, hashtable->size, mixed,
+                           &hashtable->tombstones);
+}
+
+/*
+ * Moves all keys to a new array of "size" slots. Also used with the current
+ * size to remove tombstones.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_u64_resize(hashtable_u64_t *hashtable,
+                                unsigned long size) {
+
+    hashtable_u64_t old = *hashtable;
+    unsigned long slot;
+    unsigned long i;
+
+    if (hashtable_u64_alloc(hashtable, size) != 0) {
+        *hashtable = old;
+        return -1;
+    }
+
+    for (i = 0; i < old.size; i++) {
+        if (old.ctrl[i] < 0)
+            continue;
+        slot = hashtable_u64_claim(hashtable,
+                                   hashtable_mix(old.slots[i].key ^
+                                                 hashtable->seed));
+        hashtable->slots[slot] = old.slots[i];
+    }
+
+    free(old.ctrl);
+    return 0;
+}
+
+/*
+ * Creates a new table of integer keys.
+ * Return: NULL if error, pointer to table on success.
+ */
+hashtable_u64_t *hashtable_u64_create(unsigned long size,
+                                      fp_delete value_delete_function) {
+
+    hashtable_u64_t *hashtable = NULL;
+
+    hashtable = (hashtable_u64_t *) malloc (sizeof(hashtable_u64_t));
+    if (hashtable == NULL)
+        return NULL;
+
+    if (hashtable_u64_alloc(hashtable, hashgroup_slots(size)) != 0) {
+        free(hashtable);
+        return NULL;
+    }
+
+    hashtable->count = 0;
+    hashtable->seed = hashtable_table_seed();
+    hashtable->value_delete = value_delete_function;
+
+    return hashtable;
+}
+
+/*
+ * Introduces a new key-value pair or replaces the value of a key.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_u64_set(hashtable_u64_t *hashtable, uint64_t key, void *value) {
+
+    uint64_t mixed;
+    unsigned long slot;
+    unsigned long size;
+
+    if (hashtable == NULL)
+        return -1;
+
+    mixed = hashtable_mix(key ^ hashtable->seed);
+    size = hashtable->size;
+
+    slot = hashtable_u64_find(hashtable, key, mixed);
+    if (slot < size) {
+        if (hashtable->value_delete != NULL)
+            hashtable->value_delete(hashtable->slots[slot].value);
+        hashtable->slots[slot].value = value;
+        return 0;
+    }
+
+    size = hashgroup_resize_size(size, hashtable->count,
+                                 hashtable->tombstones,
+                                 size / 8 * HASHTABLE_OA_MAX_LOAD_EIGHTHS);
+    if (size != 0 && hashtable_u64_resize(hashtable, size) != 0 &&
+        hashtable->count + hashtable->tombstones >= hashtable->size)
+        return -1;
+
+    slot = hashtable_u64_claim(hashtable, mixed);
+    hashtable->slots[slot].key = key;
+    hashtable->slots[slot].value = value;
+    hashtable->count++;
+
+    return 0;
+}
+
+/*
+ * Gets the value associated to a key.
+ * Return: NULL if not found, value on success.
+ */
+void *hashtable_u64_get(hashtable_u64_t *hashtable, uint64_t key) {
+
+    unsigned long slot;
+
+    if (hashtable == NULL)
+        return NULL;
+
+    slot = hashtable_u64_find(hashtable, key,
+                              hashtable_mix(key ^ hashtable->seed));
+    if (slot == hashtable->size)
+        return NULL;
+
+    return hashtable->slots[slot].value;
+}
+
+/*
+ * Deletes a key-value pair, freeing the value with the value delete function.
+ * Return: -1 on error, 0 on success (also if the key was not in the table).
+ */
+int hashtable_u64_delete_key(hashtable_u64_t *hashtable, uint64_t key) {
+
+    unsigned long slot;
+
+    if (hashtable == NULL)
+        return -1;
+
+    slot = hashtable_u64_find(hashtable, key,
+                              hashtable_mix(key ^ hashtable->seed));
+    if (slot == hashtable->size)
+        return 0;
+
+    if (hashtable->value_delete != NULL)
+        hashtable->value_delete(hashtable->slots[slot].value);
+
+    hashgroup_erase(hashtable->ctrl, slot, &hashtable->tombstones);
+    hashtable->count--;
+
+    return 0;
+}
+
+/*
+ * Return: Number of keys in the table, 0 if "hashtable" is NULL.
+ */
+unsigned long hashtable_u64_count(hashtable_u64_t *hashtable) {
+
+    if (hashtable == NULL)
+        return 0;
+
+    return hashtable->count;
+}
+
+/*
+ * Returns the next key-value pair from slot "*position" on.
+ * Return: 1 if a pair was returned, 0 at the end.
+ */
+int hashtable_u64_next(hashtable_u64_t *hashtable, unsigned long *position,
+                       uint64_t *key, void **value) {
+
+    if (hashtable == NULL || position == NULL)
+        return 0;
+
+    for (; *position < hashtable->size; (*position)++) {
+        if (hashtable->ctrl[*position] < 0)
+            continue;
+        if (key != NULL)
+            *key = hashtable->slots[*position].key;
+        if (value != NULL)
+            *value = hashtable->slots[*position].value;
+        (*position)++;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Frees all allocated memory in a table of integer keys, values with the
+ * value delete function.
+ */
+void hashtable_u64_delete(hashtable_u64_t *hashtable) {
+
+    unsigned long i;
+
+    if (hashtable == NULL)
+        return;
+
+    if (hashtable->value_delete != NULL)
+        for (i = 0; i < hashtable->size; i++)
+            if (hashtable->ctrl[i] >= 0)
+                hashtable->value_delete(hashtable->slots[i].value);
+
+    free(hashtable->ctrl);
+    free(hashtable);
+}
+
+
+/**** CALCULATE HASH VALUE FUNCTIONS ******************************************/
+
+/*
+ * The functions below implement wyhash (final version 4) by Wang Yi, released
+ * into the public domain: github.com/wangyi-fudan/wyhash
+ * Input is read 8 bytes at a time in little endian order.
+ */
+
+static const uint64_t hashtable_wyhash_secret[4] = {
+    UINT64_C(0x2d358dccaa6c78a5), UINT64_C(0x8bb84b93962eacc9),
+    UINT64_C(0x4b33a62ed433d4a3), UINT64_C(0x4d5a2da51de1aa47)
+};
+
+/*
+ * 64x64 bit multiplication, low half of the result in "a", high half in "b".
+ */
+static void hashtable_wymum(uint64_t *a, uint64_t *b) {
+
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128) *a * *b;
+
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t) *a, lb = (uint32_t) *b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t hashtable_wymix(uint64_t a, uint64_t b) {
+
+    hashtable_wymum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t hashtable_wyr8(const unsigned char *p) {
+
+    return (uint64_t) p[0] | (uint64_t) p[1] << 8 |
+           (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24 |
+           (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 |
+           (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+static uint64_t hashtable_wyr4(const unsigned char *p) {
+
+    return (uint64_t) p[0] | (uint64_t) p[1] << 8 |
+           (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24;
+}
+
+static uint64_t hashtable_wyr3(const unsigned char *p, size_t length) {
+
+    return (uint64_t) p[0] << 16 | (uint64_t) p[length >> 1] << 8 |
+           p[length - 1];
+}
+
+/*
+ * Calculates the hash value of "length" bytes with wyhash and a seed.
+ * Return: Hash value of data, if parameter "data" is NULL it returns 0.
+ */
+unsigned long bytes_hash_value(const void *data, size_t length,
+                               unsigned long seed) {
+
+    const uint64_t *secret = hashtable_wyhash_secret;
+    const unsigned char *p = (const unsigned char *) data;
+    uint64_t s = seed;
+    uint64_t see1, see2;
+    uint64_t a, b;
+    size_t i;
+
+    if (data == NULL)
+        return 0;
+
+    s ^= hashtable_wymix(s ^ secret[0], secret[1]);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            a = hashtable_wyr4(p) << 32 |
+                hashtable_wyr4(p + ((length >> 3) << 2));
+            b = hashtable_wyr4(p + length - 4) << 32 |
+                hashtable_wyr4(p + length - 4 - ((length >> 3) << 2));
+        }
+        else if (length > 0) {
+            a = hashtable_wyr3(p, length);
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        i = length;
+        if (i > 48) {
+            see1 = s;
+            see2 = s;
+            do {
+                s = hashtable_wymix(hashtable_wyr8(p) ^ secret[1],
+                                    hashtable_wyr8(p + 8) ^ s);
+                see1 = hashtable_wymix(hashtable_wyr8(p + 16) ^ secret[2],
+                                       hashtable_wyr8(p + 24) ^ see1);
+                see2 = hashtable_wymix(hashtable_wyr8(p + 32) ^ secret[3],
+                                       hashtable_wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            s ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            s = hashtable_wymix(hashtable_wyr8(p) ^ secret[1],
+                                hashtable_wyr8(p + 8) ^ s);
+            i -= 16;
+            p += 16;
+        }
+        a = hashtable_wyr8(p + i - 16);
+        b = hashtable_wyr8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= s;
+    hashtable_wymum(&a, &b);
+
+    return (unsigned long) hashtable_wymix(a ^ secret[0] ^ length,
+                                           b ^ secret[1]);
+}
+
+/*
+ * Calculates the hash value of a string with wyhash and a seed.
+ * Return: Hash value of string, if parameter "string" is NULL it returns 0.
+ */
+unsigned long string_hash_value_seeded(void *string, unsigned long seed) {
+
+    if (string == NULL)
+        return 0;
+
+    return bytes_hash_value(string, strlen((char *) string), seed);
+}
+
+/*
+ * Calculates the hash value of a string with wyhash and a seed chosen at
+ * random once per process.
+ * Return: Hash value of string, if parameter "string" is NULL it returns 0.
+ */
+unsigned long string_hash_value(void *string) {
+
+    if (string == NULL)
+        return 0;
+
+    return bytes_hash_value(string, strlen((char *) string),
+                            (unsigned long) hashtable_get_process_seed());
 }
@@ -10,6 +10,9 @@
 #ifndef _HASHTABLE_H_
 #define _HASHTABLE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 /*
  * Pointer to function that compare two keys.
  * Return: (= 0) key1 = key2, (< 0) key1 < key2, (> 0) key1 > key2.
@@ -22,6 +25,13 @@ typedef int (*fp_compare_keys)(void *key1, void *key2);
  */
 typedef unsigned long (*fp_hashvalue)(void *key);
 
+/*
+ * Pointer to function that calculates the hash value of a key with a seed.
+ * Different seeds must give unrelated hash values.
+ * Return: Hash value of key.
+ */
+typedef unsigned long (*fp_hashvalue_seeded)(void *key, unsigned long seed);
+
 /*
  * Pointer to function that frees allocated memory of a key/value.
  * You don't need it if you don't allocate memory to create key/value.
@@ -33,9 +43,259 @@ typedef void (*fp_delete)(void *key_or_value);
  */
 typedef struct hashtable_s hashtable_t;
 
+/*
+ * Storage engines of a hash table.
+ *
+ * HASHTABLE_BACKEND_CHAINED: an array of buckets, each one a linked list of
+ * allocated nodes. Resizes incrementally.
+ * HASHTABLE_BACKEND_OPEN_ADDRESSING: keys and values are stored directly in an
+ * array of slots with one control byte per slot, and 16 control bytes are
+ * checked at once when searching (with SSE2 when available). No allocation
+ * per key and about half the memory per key, but resizes move all keys at
+ * once and never use more than 7/8 of the slots.
+ * HASHTABLE_BACKEND_MAPPED: read-only table served from a snapshot file
+ * mapped in memory. Only created by hashtable_open_mapped().
+ */
+typedef enum hashtable_backend_e {
+    HASHTABLE_BACKEND_CHAINED,
+    HASHTABLE_BACKEND_OPEN_ADDRESSING,
+    HASHTABLE_BACKEND_MAPPED
+} hashtable_backend_t;
+
+/*
+ * Pointer to function that calculates the number of bytes of a key/value.
+ * Return: Length in bytes.
+ */
+typedef size_t (*fp_length)(void *key_or_value);
+
+/*
+ * Pointer to function that receives the key-value pairs evicted from a cache
+ * (see hashtable_options_t). Parameter "data" is the "evict_data" option. It
+ * owns the key and value and cannot use the table.
+ */
+typedef void (*fp_evict)(void *key, void *value, void *data);
+
+/*
+ * Pointer to function called for every key-value pair by hashtable_scan().
+ * Parameter "data" is the pointer passed to hashtable_scan().
+ */
+typedef void (*fp_scan)(void *key, void *value, void *data);
+
+/*
+ * Pointer to function that combines the values of a key found in both tables
+ * of a merge (see hashtable_merge()). Parameter "value" is the value in the
+ * destination table and "other" the one merged into it. It owns both values,
+ * so it frees the one it doesn't return if needed.
+ * Return: Value the key keeps.
+ */
+typedef void *(*fp_combine)(void *value, void *other);
+
+/*
+ * Iterator over the key-value pairs of a hash table. Fields are private.
+ */
+typedef struct hashtable_iterator_s {
+    hashtable_t *hashtable;
+    unsigned long index;
+    int phase;
+    void *node;
+    struct hashtable_iterator_s *next;
+} hashtable_iterator_t;
+
+/*
+ * Allocator of the memory of a hash table: the table itself, its bucket
+ * arrays (or slots), nodes, node pool slabs, arena and timing wheel, and the
+ * large work arrays of hashtable_build_from_arrays(). Keys and values are
+ * not allocated by the table.
+ * "alloc" returns a block of "size" bytes, NULL if there is no memory.
+ * "free" releases a block of "size" bytes returned by "alloc" or "realloc".
+ * "realloc" resizes a block of "old_size" bytes to "size" bytes keeping its
+ * contents, and returns NULL (leaving the block as it was) if there is no
+ * memory. Power of two tables grow their bucket array with it in
+ * hashtable_reserve().
+ * All of them receive "context". With the "threads" option greater than 1
+ * they can be called by several threads at once.
+ */
+typedef struct hashtable_allocator_s {
+    void *(*alloc)(size_t size, void *context);
+    void (*free)(void *pointer, size_t size, void *context);
+    void *(*realloc)(void *pointer, size_t old_size, size_t size,
+                     void *context);
+    void *context;
+} hashtable_allocator_t;
+
+/*
+ * Options of a hash table. Initialize them with hashtable_options_init() and
+ * change only the fields you need.
+ *
+ * "max_load_factor": when the number of keys divided by the number of buckets
+ * goes above it the table doubles its number of buckets. 0 disables growth.
+ * Default: 1.0.
+ * "min_load_factor": when the number of keys divided by the number of buckets
+ * goes below it the table halves its number of buckets, never below the
+ * initial size. 0 disables shrinking. It must be at most half of
+ * "max_load_factor". Default: 0.
+ * "rehash_step": number of buckets moved to the new bucket array in every
+ * hashtable_set(), hashtable_get() and hashtable_delete_key() call while the
+ * table is being resized. Resizing is incremental, so no call ever moves the
+ * whole table (except with several "threads"). Default: 4.
+ * "backend": storage engine, see hashtable_backend_t. With open addressing
+ * "size" is the number of slots (rounded up to a power of two, at least 16),
+ * the load factor never goes above 7/8 and "rehash_step" is not used.
+ * Default: HASHTABLE_BACKEND_CHAINED.
+ * "node_pool_slab_size": if greater than 0, nodes of a chained table are
+ * allocated in slabs of this many nodes, deleted nodes are reused by later
+ * insertions and all slabs are freed at once by hashtable_delete(). A few
+ * hundred or thousand nodes per slab is a good value. Memory of deleted nodes
+ * is not returned to the system until the table is deleted. 0 allocates every
+ * node with malloc. Default: 0.
+ * "exact_size": by default a chained table rounds its number of buckets up to
+ * a power of two and selects buckets by masking a mixed hash value. If not 0,
+ * the table uses exactly "size" buckets (and multiples of it when resizing)
+ * and selects buckets with a multiplication and a shift of the mixed hash
+ * value. Neither way uses a division. Default: 0.
+ * "hashvalue_seeded": if not NULL, the table hashes keys with this function
+ * and its own seed instead of with "hashvalue_function", so keys chosen to
+ * collide in one table do not collide in another. string_hash_value_seeded()
+ * is the one to use for strings. Default: NULL.
+ * "seed": seed passed to "hashvalue_seeded". 0 derives a new seed from the
+ * random seed of the process (only if "hashvalue_seeded" is set). Tables
+ * that share keys hashed with hashtable_hash_key() must use the same seed.
+ * Default: 0.
+ * "threads": number of threads used by the parallel operations of the table,
+ * like hashtable_build_from_arrays() and hashtable_merge_shards(). With more
+ * than 1, a chained table with tens of thousands of buckets or more resizes
+ * at once, every thread moving a range of the old buckets to its own range
+ * of the new ones, instead of a few buckets per operation (hashtable_reserve()
+ * and hashtable_shrink_to_fit() too). Default: 1.
+ * "counters": if not 0, lookups (hashtable_get() and the functions built on
+ * it) count lookups, hits, misses and probes, read with hashtable_stats().
+ * It costs a few increments per lookup. Default: 0.
+ * "intern_keys": if not 0, the table stores a copy of every key it introduces
+ * in an arena of its own (a few large blocks, all freed by hashtable_delete())
+ * and compares keys by length and bytes, so "compare_function" can be NULL and
+ * "key_delete_function" is not used. Keys passed to the table can be freed or
+ * reused as soon as the call returns. Space of deleted or replaced keys is not
+ * reused until the table is deleted. Default: 0.
+ * "key_length": length in bytes of a key to copy with "intern_keys". NULL
+ * treats keys as C strings (strlen() plus the null character). Default: NULL.
+ * "intern_values" and "value_length": the same for the values introduced with
+ * hashtable_set() and hashtable_set_if_absent(); "value_delete_function" is
+ * not used. Meant for small values. Default: 0 and NULL.
+ * "max_entries": if greater than 0 the table is a cache of at most this many
+ * keys. Introducing a key into a full cache first evicts another one with the
+ * CLOCK algorithm: hashtable_get() and hashtable_set() of a key already in
+ * the cache mark it as used (one byte, written only if it was clear), and a
+ * hand going around the slots evicts the first key not used since it last
+ * passed, so keys used often stay. Caches always use the open addressing
+ * backend and cannot intern keys or values. Default: 0.
+ * "max_bytes": if greater than 0 the table is a cache of at most this many
+ * bytes, counting every key ("key_length"), every value ("value_length", 0 for
+ * NULL) and the slot holding them. Values changed through the pointer of
+ * hashtable_upsert() are counted on the next hashtable_set() of the key.
+ * Default: 0.
+ * "evict" and "evict_data": function that receives evicted keys and values.
+ * NULL frees them with the delete functions of the table. Default: NULL.
+ * "ttl": if not 0, keys introduced with hashtable_set_ttl() expire after
+ * their time to live. An expired key is never found, and it is removed
+ * (freeing key and value with the delete functions) when it is looked up or
+ * by a timing wheel that every operation advances a few keys. Keys not yet
+ * removed still count and are still visited by iterators. The table uses
+ * the open addressing backend. Default: 0.
+ * "expire_step": number of keys the timing wheel of a "ttl" table looks at
+ * in every hashtable_set(), hashtable_get() and hashtable_delete_key() call.
+ * Default: 4.
+ */
+typedef struct hashtable_options_s {
+    float max_load_factor;
+    float min_load_factor;
+    unsigned long rehash_step;
+    hashtable_backend_t backend;
+    unsigned long node_pool_slab_size;
+    int exact_size;
+    fp_hashvalue_seeded hashvalue_seeded;
+    unsigned long seed;
+    unsigned int threads;
+    int counters;
+    int intern_keys;
+    fp_length key_length;
+    int intern_values;
+    fp_length value_length;
+    unsigned long max_entries;
+    size_t max_bytes;
+    fp_evict evict;
+    void *evict_data;
+    int ttl;
+    unsigned long expire_step;
+} hashtable_options_t;
+
+/*
+ * Number of chain lengths counted in hashtable_stats_t.
+ */
+#define HASHTABLE_STATS_HISTOGRAM_SIZE 16
+
+/*
+ * Statistics of a hash table, filled by hashtable_stats().
+ *
+ * "count": number of keys.
+ * "buckets": number of buckets (of both bucket arrays while resizing), or
+ * slots of an open addressing table.
+ * "empty_buckets" and "empty_bucket_ratio": buckets (or slots) without keys.
+ * "load_factor": keys per bucket (or slot).
+ * "chain_histogram": chain_histogram[i] is the number of buckets with i keys,
+ * the last one counts longer chains too. On open addressing tables it is the
+ * number of keys found by visiting i groups of slots.
+ * "max_chain": length of the longest chain (or probe sequence, in groups).
+ * "tombstones": slots of deleted keys of an open addressing table.
+ * "resizing": 1 while a chained table is being resized.
+ * "bucket_bytes": memory of the bucket arrays (control bytes and slots of open
+ * addressing tables, with the charges and reference bytes of caches and the
+ * expiration times and timer links of keys with a time to live, bucket
+ * offsets of mapped tables).
+ * "node_bytes": memory of the nodes (slabs of the node pool, entries of
+ * mapped tables), without the keys and values they point to.
+ * "arena_bytes": memory of the arena of interned keys and values.
+ * "total_bytes": "bucket_bytes", "node_bytes" and "arena_bytes" plus the
+ * table itself.
+ * "cache_bytes" and "evictions": bytes counted by a cache with "max_bytes",
+ * and keys evicted from a cache since it was created.
+ * "expirations": expired keys removed since the table was created.
+ * "lookups", "hits", "misses", "probes" and "average_probes": lookups done
+ * since the table was created or hashtable_stats_reset() was called, and the
+ * nodes (groups of slots for open addressing tables) they visited. Only
+ * counted with the "counters" option.
+ */
+typedef struct hashtable_stats_s {
+    unsigned long count;
+    unsigned long buckets;
+    unsigned long empty_buckets;
+    float empty_bucket_ratio;
+    float load_factor;
+    unsigned long chain_histogram[HASHTABLE_STATS_HISTOGRAM_SIZE];
+    unsigned long max_chain;
+    unsigned long tombstones;
+    int resizing;
+    size_t bucket_bytes;
+    size_t node_bytes;
+    size_t arena_bytes;
+    size_t total_bytes;
+    size_t cache_bytes;
+    unsigned long evictions;
+    unsigned long expirations;
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long probes;
+    float average_probes;
+} hashtable_stats_t;
+
+/*
+ * Fills "options" with the default values used by hashtable_create().
+ */
+void hashtable_options_init(hashtable_options_t *options);
+
 /*
  * Creates a new hash table.
- * Parameter "size" must be greater than 0.
+ * Parameter "size" must be greater than 0, it is rounded up to a power of two.
  * Parameter "compare_function" cannot be NULL, is needed to compare keys.
  * Parameter "hashvalue_function" cannot be NULL, is needed to calculate key
  * position in the hash table.
@@ -52,6 +312,150 @@ typedef struct hashtable_s hashtable_t;
                                fp_delete key_delete_function,
                                fp_delete value_delete_function);
 
+/*
+ * Same as hashtable_create(), but with the behaviour described in "options".
+ * Parameter "size" is the initial number of buckets.
+ * Parameter "hashvalue_function" can be NULL if "options->hashvalue_seeded"
+ * is set.
+ * Parameter "options" can be NULL to use the default options.
+ * Return: NULL if error (also if options are not valid), pointer to hashtable
+ * on success.
+ */
+hashtable_t *hashtable_create_with_options(unsigned long size,
+                                           fp_compare_keys compare_function,
+                                           fp_hashvalue hashvalue_function,
+                                           fp_delete key_delete_function,
+                                           fp_delete value_delete_function,
+                                           const hashtable_options_t *options);
+
+/*
+ * Same as hashtable_create_with_options(), but all memory of the table comes
+ * from "allocator" (see hashtable_allocator_t), which is copied.
+ * Parameter "allocator" can be NULL to use malloc.
+ * Return: NULL if error, pointer to hashtable on success.
+ */
+hashtable_t *hashtable_create_with_allocator(unsigned long size,
+                                    fp_compare_keys compare_function,
+                                    fp_hashvalue hashvalue_function,
+                                    fp_delete key_delete_function,
+                                    fp_delete value_delete_function,
+                                    const hashtable_options_t *options,
+                                    const hashtable_allocator_t *allocator);
+
+/*
+ * Fills "allocator" with the built-in allocator for very large tables.
+ * Blocks of 2 MB or more (bucket arrays, slots, large slabs and arena
+ * chunks) are mapped with mmap() aligned to 2 MB and marked with
+ * MADV_HUGEPAGE, so the kernel can back them with transparent huge pages and
+ * random lookups miss the TLB less. If "numa_node" is not -1 they are also
+ * bound with mbind() to that NUMA node, preferred but not required (memory
+ * of other nodes is used when it has none left). Smaller blocks come from
+ * malloc. Huge pages and NUMA binding are advice to the kernel, where it
+ * does not support them the memory is still allocated.
+ * Return: 0 on success, -1 on error ("numa_node" not valid).
+ */
+int hashtable_allocator_huge_pages(hashtable_allocator_t *allocator,
+                                   int numa_node);
+
+/*
+ * Creates a hash table with "n" key-value pairs (keys[i], values[i]). The
+ * bucket array is allocated once with its final size, and with the "threads"
+ * option greater than 1 the keys are hashed and linked into their buckets in
+ * parallel, every thread owning a range of buckets. Nodes of tables with a
+ * node pool are allocated in a single slab.
+ * Parameter "values" can be NULL to set all values to NULL.
+ * Parameter "unique_keys" can be 1 if the caller guarantees that there are no
+ * repeated keys, to skip searching for them. Otherwise repeated keys are
+ * handled as hashtable_set() does: the first key stays with the last value.
+ * The rest of parameters are the ones of hashtable_create_with_options().
+ * Open addressing tables are built with one thread.
+ * Return: NULL if error (the caller keeps the ownership of keys and values,
+ * except of values replaced by repeated keys), pointer to hashtable on
+ * success.
+ */
+hashtable_t *hashtable_build_from_arrays(void **keys, void **values,
+                                         unsigned long n, int unique_keys,
+                                         fp_compare_keys compare_function,
+                                         fp_hashvalue hashvalue_function,
+                                         fp_delete key_delete_function,
+                                         fp_delete value_delete_function,
+                                         const hashtable_options_t *options);
+
+/*
+ * Creates "n" hash tables (shards) with the same parameters, as
+ * hashtable_create_with_options() does, and the same seed (the "seed" option,
+ * or a random one shared by all of them when it is 0). Every thread fills its
+ * own shard without locks, and hashtable_merge_shards() joins them at the
+ * end. A destination table created with the seed of the shards (see
+ * hashtable_seed()) reuses the hash values of their keys.
+ * Return: NULL if error, array of "n" tables on success (free it with
+ * hashtable_delete_shards()).
+ */
+hashtable_t **hashtable_create_shards(unsigned long n, unsigned long size,
+                                      fp_compare_keys compare_function,
+                                      fp_hashvalue hashvalue_function,
+                                      fp_delete key_delete_function,
+                                      fp_delete value_delete_function,
+                                      const hashtable_options_t *options);
+
+/*
+ * Frees "n" tables created by hashtable_create_shards() and the array that
+ * holds them.
+ */
+void hashtable_delete_shards(hashtable_t **shards, unsigned long n);
+
+/*
+ * Moves all key-value pairs of "source" into "hashtable", leaving "source"
+ * empty. A key already in "hashtable" gets the value returned by "combine",
+ * or the value of "source" if "combine" is NULL (freeing the old one with
+ * the value delete function); the key of "source" is freed with its key
+ * delete function. Both tables should have the same compare and delete
+ * functions.
+ * Nodes of a chained "source" are linked into a chained "hashtable" without
+ * allocating them again if both or neither have a node pool: the slabs of
+ * "source" go to "hashtable". Other pairs take a new node or slot. The
+ * arena of "source" also goes to "hashtable", so both must intern keys (and
+ * values) or neither. Times to live of "source" are dropped (expired keys
+ * are freed). Nodes keep their hash values if both tables hash the same way.
+ * Return: 0 on success, -1 on error (mapped tables, iterators in use, or no
+ * memory: some pairs may have been moved already).
+ */
+int hashtable_merge(hashtable_t *hashtable, hashtable_t *source,
+                    fp_combine combine);
+
+/*
+ * Same as calling hashtable_merge() with every one of "n" shards, but with
+ * the "threads" option of "hashtable" greater than 1 the merge runs in
+ * parallel: "hashtable" grows once to hold all keys and every thread owns a
+ * range of its buckets, so threads never wait for each other. Keys repeated
+ * in several shards are combined in no particular order, and "combine" and
+ * the delete functions can run on several threads at once. Tables that
+ * cannot take the nodes of the shards (see hashtable_merge()) are merged
+ * with one thread.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_merge_shards(hashtable_t *hashtable, hashtable_t **shards,
+                           unsigned long n, fp_combine combine);
+
+/*
+ * Calculates the hash value of a key with the hash function (and seed) of a
+ * hash table. Use it to get the "hash" parameter of the *_hashed functions.
+ * Return: Hash value of key.
+ */
+unsigned long hashtable_hash_key(hashtable_t *hashtable, void *key);
+
+/*
+ * Return: Seed the table passes to its seeded hash function (the "seed"
+ * option, or the one derived when it was 0). 0 if the table has no seeded
+ * hash function and no "seed" option.
+ */
+unsigned long hashtable_seed(hashtable_t *hashtable);
+
+/*
+ * Return: Number of keys in the table, 0 if "hashtable" is NULL.
+ */
+unsigned long hashtable_count(hashtable_t *hashtable);
+
 /*
 * If the key doesn't exist in the hash table a new key-value pair is introduced
 * into the hash table, if it exist, it replaces the value with the one passed
@@ -61,27 +465,413 @@ typedef struct hashtable_s hashtable_t;
 */
 int hashtable_set(hashtable_t *hashtable, void *key, void *value);
 
+/*
+ * Same as hashtable_set(), but with the hash value of the key already
+ * calculated by the caller, so a key can be hashed once and used with several
+ * tables. Parameter "hash" must be the value the table's hash function returns
+ * for "key".
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_set_hashed(hashtable_t *hashtable, void *key, void *value,
+                         unsigned long hash);
+
+/*
+ * Finds the value of a key, introducing the key with a NULL value if it is
+ * not in the table, with a single search. The caller reads or writes the
+ * value through the returned pointer, so counting or memoization needs no
+ * second lookup:
+ *
+ *     void **count = hashtable_upsert(table, word, &inserted);
+ *     *count = (void *) ((uintptr_t) *count + 1);
+ *
+ * The pointer is valid until the next call that modifies the table (open
+ * addressing tables move values when they grow; values of chained tables
+ * stay in place until their key is deleted). If "*inserted" is 0 the table
+ * kept its own key and "key" still belongs to the caller. The value delete
+ * function is not called for values replaced through the pointer.
+ * Parameter "inserted" receives 1 if the key was introduced, 0 if it was
+ * already in the table. It can be NULL.
+ * Return: NULL on error, pointer to the value of the key on success.
+ */
+void **hashtable_upsert(hashtable_t *hashtable, void *key, int *inserted);
+
+/*
+ * Same as hashtable_upsert(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: NULL on error, pointer to the value of the key on success.
+ */
+void **hashtable_upsert_hashed(hashtable_t *hashtable, void *key,
+                               unsigned long hash, int *inserted);
+
+/*
+ * Introduces a key-value pair only if the key is not in the table, with a
+ * single search. If the key is already in the table nothing changes and
+ * "key" and "value" still belong to the caller.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_set_if_absent(hashtable_t *hashtable, void *key, void *value);
+
+/*
+ * Same as hashtable_set_if_absent(), but with the hash value of the key
+ * already calculated by the caller.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_set_if_absent_hashed(hashtable_t *hashtable, void *key,
+                                   void *value, unsigned long hash);
+
+/*
+ * Uses the values of a table as integer counters: adds "delta" to the counter
+ * of a key, introducing the key with a counter of 0 if it is not in the table,
+ * with a single search. Counters are stored in the value pointers, read them
+ * with (long) (intptr_t) hashtable_get(table, key). The table cannot have a
+ * value delete function, "intern_values" or "max_bytes". If the key is
+ * introduced the table keeps it (or a copy with "intern_keys"), otherwise
+ * "key" still belongs to the caller.
+ * Parameter "count" receives the new counter. It can be NULL.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_incr(hashtable_t *hashtable, void *key, long delta,
+                   long *count);
+
+/*
+ * Same as hashtable_incr(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_incr_hashed(hashtable_t *hashtable, void *key, long delta,
+                          unsigned long hash, long *count);
+
+/*
+ * Same as hashtable_incr_hashed() for a key already in the table, but the
+ * counter is updated with an atomic fetch-add and nothing else of the table
+ * is modified: several threads can call it at once (and with
+ * hashtable_peek_hashed() or hashtable_top_k()) as long as no thread modifies
+ * the table otherwise. Missing keys are not introduced.
+ * Return: 0 on success, -1 if the key is not in the table or on error.
+ */
+int hashtable_incr_shared_hashed(hashtable_t *hashtable, void *key,
+                                 long delta, unsigned long hash,
+                                 long *count);
+
+/*
+ * Finds the "k" keys with the largest counters (see hashtable_incr()) with a
+ * heap of "k" keys, without copying or modifying the table. Keys are returned
+ * in "keys" and their counters in "counts", both with room for "k" elements,
+ * from the largest counter to the smallest. The keys belong to the table.
+ * Return: Number of keys returned, less than "k" if the table has less keys.
+ */
+unsigned long hashtable_top_k(hashtable_t *hashtable, unsigned long k,
+                              void **keys, long *counts);
+
+/*
+ * Same as hashtable_set(), but the key expires "ttl" milliseconds from now,
+ * never if "ttl" is 0. hashtable_set() of the key later removes its time to
+ * live. The table must be created with the "ttl" option.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_set_ttl(hashtable_t *hashtable, void *key, void *value,
+                      unsigned long ttl);
+
+/*
+ * Removes expired keys of a table with the "ttl" option, looking at "max_keys"
+ * keys at most. Operations on the table already remove a few expired keys
+ * each, so this is only needed to release memory of a table that is not
+ * used for a while.
+ * Return: Number of keys removed.
+ */
+unsigned long hashtable_expire(hashtable_t *hashtable, unsigned long max_keys);
+
 /*
  * Gets the value associated to a key.
  * Return: NULL on error, value on success.
  */
 void *hashtable_get(hashtable_t *hashtable, void *key);
 
+/*
+ * Same as hashtable_get(), but with the hash value of the key already
+ * calculated by the caller. Parameter "hash" must be the value the table's
+ * hash function returns for "key".
+ * Return: NULL on error, value on success.
+ */
+void *hashtable_get_hashed(hashtable_t *hashtable, void *key,
+                           unsigned long hash);
+
+/*
+ * Same as hashtable_get_hashed(), but never modifies the table (it does not
+ * advance a resize in progress). Several threads can call it at the same time
+ * as long as no thread is modifying the table.
+ * Return: NULL on error, value on success.
+ */
+void *hashtable_peek_hashed(hashtable_t *hashtable, void *key,
+                            unsigned long hash);
+
+/*
+ * Gets the values associated to "n" keys. Keys are hashed and the memory
+ * their lookups need is prefetched in chunks, so cache misses of different
+ * keys overlap instead of happening one after another. Faster than calling
+ * hashtable_get() in a loop when the table does not fit in cache.
+ * Parameter "values" must have room for "n" values, values[i] is set to the
+ * value of keys[i], or to NULL if not found.
+ * Return: Number of keys found, or 0 on error.
+ */
+unsigned long hashtable_get_batch(hashtable_t *hashtable, void **keys,
+                                  unsigned long n, void **values);
+
+/*
+ * Sets "n" key-value pairs (keys[i], values[i]) as hashtable_set() does, with
+ * the same prefetching as hashtable_get_batch().
+ * Parameter "values" can be NULL to set all values to NULL.
+ * Return: 0 on success, -1 if any pair could not be set (the rest are set).
+ */
+int hashtable_set_batch(hashtable_t *hashtable, void **keys, void **values,
+                        unsigned long n);
+
 /*
  * Deletes a key and its associated value from a hash table.
  * Return: -1 on error, 0 on success.
  */
  int hashtable_delete_key(hashtable_t *hashtable, void *key);
 
+/*
+ * Same as hashtable_delete_key(), but with the hash value of the key already
+ * calculated by the caller. Parameter "hash" must be the value the table's
+ * hash function returns for "key".
+ * Return: -1 on error, 0 on success.
+ */
+int hashtable_delete_key_hashed(hashtable_t *hashtable, void *key,
+                                unsigned long hash);
+
+/*
+ * Removes a key-value pair and returns its value instead of freeing it with
+ * the value delete function. The key is freed with the key delete function.
+ * Return: Value of the key, NULL if not found (or if the value was NULL) or
+ * on error.
+ */
+void *hashtable_take(hashtable_t *hashtable, void *key);
+
+/*
+ * Same as hashtable_take(), but with the hash value of the key already
+ * calculated by the caller.
+ * Return: Value of the key, NULL if not found or on error.
+ */
+void *hashtable_take_hashed(hashtable_t *hashtable, void *key,
+                            unsigned long hash);
+
+/*
+ * Removes all key-value pairs of a hash table, freeing keys and values with
+ * the delete functions, but keeps its buckets (or slots), node pool and the
+ * newest block of its arena, so a table can be refilled without allocating
+ * again. Without delete functions open addressing and pooled tables are
+ * emptied without visiting their keys. No iterator can be in use.
+ */
+void hashtable_clear(hashtable_t *hashtable);
+
+/*
+ * Grows a hash table at once so that it holds "n" keys without resizing.
+ * Nothing changes if it already does.
+ * Return: 0 on success, -1 on error (no memory, mapped table or iterators in
+ * use).
+ */
+int hashtable_reserve(hashtable_t *hashtable, unsigned long n);
+
+/*
+ * Shrinks a hash table at once to the fewest buckets (or slots) that hold its
+ * keys, never below its initial size, and removes the tombstones of an open
+ * addressing table. Useful after deleting many keys. Memory of the node pool
+ * and the arena is kept.
+ * Return: 0 on success, -1 on error (no memory, mapped table or iterators in
+ * use).
+ */
+int hashtable_shrink_to_fit(hashtable_t *hashtable);
+
  /*
   * Frees all allocated memory in a hash table.
   */
  void hashtable_delete(hashtable_t *hashtable);
 
+/*
+ * Fills "stats" with the statistics of a table. It reads every bucket (and
+ * searches every key of open addressing tables), so it takes as long as
+ * iterating over the table. It does not modify the table.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_stats(hashtable_t *hashtable, hashtable_stats_t *stats);
+
+/*
+ * Calculates "load_factor", "empty_bucket_ratio" and "average_probes" of
+ * "stats" from its other fields. Use it after adding the statistics of
+ * several tables.
+ */
+void hashtable_stats_ratios(hashtable_stats_t *stats);
+
+/*
+ * Sets the lookup counters of a table to 0.
+ */
+void hashtable_stats_reset(hashtable_t *hashtable);
+
+/*
+ * Starts iterating over all key-value pairs of a table, in no particular
+ * order. Resizes of chained tables are paused while iterating, so the table
+ * can be used normally: any key can be deleted, and deleted keys that were
+ * not returned yet are not returned; new keys may or may not be returned. On
+ * open addressing tables new keys can make the table grow, after which the
+ * iteration may miss or repeat keys. The table keeps a pointer to the
+ * iterator until the iteration ends or hashtable_iterator_release() is
+ * called, so the iterator cannot be copied or go out of scope before that.
+ */
+void hashtable_iterator_init(hashtable_t *hashtable,
+                             hashtable_iterator_t *iterator);
+
+/*
+ * Gets the next key-value pair of an iteration. Parameters "key" and "value"
+ * can be NULL if not needed.
+ * Return: 1 if a pair was returned, 0 at the end of the iteration.
+ */
+int hashtable_iterator_next(hashtable_iterator_t *iterator, void **key,
+                            void **value);
+
+/*
+ * Ends an iteration before hashtable_iterator_next() returns 0, so paused
+ * resizes can continue. Calling it after the end of the iteration does
+ * nothing.
+ */
+void hashtable_iterator_release(hashtable_iterator_t *iterator);
+
+/*
+ * Scans a table a few buckets at a time without keeping any state between
+ * calls, like Redis SCAN. Start with cursor 0 and call it again with the
+ * returned cursor until it returns 0. Between calls the table can be used
+ * and resized freely: every key present during the whole scan is visited at
+ * least once (some keys may be visited more than once). This guarantee
+ * needs power of two sizes, on open addressing and "exact_size" tables it
+ * only holds if the table is not resized during the scan.
+ * Parameter "steps" is the number of buckets (or slots) visited by the call.
+ * Parameter "function" is called for every key-value pair visited, it cannot
+ * modify the table.
+ * Return: Cursor for the next call, 0 when the scan is finished.
+ */
+unsigned long hashtable_scan(hashtable_t *hashtable, unsigned long cursor,
+                             unsigned long steps, fp_scan function,
+                             void *data);
+
  /*
-  * Calculates the hash value of a string using djb2 algorithm by Dan Bernstein.
+  * Calculates the hash value of a string with wyhash, reading 8 bytes at a
+  * time, and a seed chosen at random once per process, so hash values change
+  * between runs. This is the recommended hash function for string keys.
   * Return: Hash value of string, if parameter "string" is NULL it returns 0.
   */
 unsigned long string_hash_value(void *string);
 
+/*
+ * Calculates the hash value of a string with wyhash and a seed. Use it as
+ * "hashvalue_seeded" option to give every table its own seed.
+ * Return: Hash value of string, if parameter "string" is NULL it returns 0.
+ */
+unsigned long string_hash_value_seeded(void *string, unsigned long seed);
+
+/*
+ * Calculates the hash value of "length" bytes with wyhash and a seed. Use it
+ * when the length of the key is known to avoid scanning it for its end.
+ * Return: Hash value of data, if parameter "data" is NULL it returns 0.
+ */
+unsigned long bytes_hash_value(const void *data, size_t length,
+                               unsigned long seed);
+
+/*
+ * Saves all key-value pairs of a table to a snapshot file at "path" (written
+ * to "path.tmp" first and renamed, so "path" is never a partial file; the
+ * file and its directory are synced before returning). Keys and values are
+ * saved as bytes, so they cannot contain pointers. Hash values are saved
+ * too, so the keys of the snapshot are never hashed again: hash values of
+ * the table must be the same in the process that opens the file. Use
+ * "hashvalue_seeded" tables (the seed is saved) or a hash function without a
+ * random seed, not string_hash_value().
+ * Parameter "key_length_function" returns the number of bytes of a key, NULL
+ * saves keys as C strings (including the terminating null character).
+ * Parameter "value_length_function" does the same for values. NULL values are
+ * saved as NULL.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_save(hashtable_t *hashtable, const char *path,
+                   fp_length key_length_function,
+                   fp_length value_length_function);
+
+/*
+ * Opens a snapshot file saved with hashtable_save() as a read-only table.
+ * The file is mapped in memory and hashtable_get() reads it directly, so the
+ * table is ready without reading the file: pages are loaded when used.
+ * Keys and values returned point into the mapped file and cannot be modified.
+ * hashtable_set() and hashtable_delete_key() return -1. hashtable_delete()
+ * unmaps the file.
+ * Parameter "compare_function" receives the key searched and a key of the
+ * file.
+ * Parameter "hashvalue_function" must be the hash function of the saved
+ * table. It can be NULL if "options->hashvalue_seeded" is set, which is
+ * used with the seed saved in the file. Other options are not used.
+ * Return: NULL if error, pointer to hashtable on success.
+ */
+hashtable_t *hashtable_open_mapped(const char *path,
+                                   fp_compare_keys compare_function,
+                                   fp_hashvalue hashvalue_function,
+                                   const hashtable_options_t *options);
+
+/*
+ * Hash table of integer keys. Keys are stored in the table itself instead of
+ * pointed to, and hashed by the table (mixed with a random seed per table),
+ * so there are no compare or hash functions: a lookup reads no memory outside
+ * the table and calls no function. Open addressing, like
+ * HASHTABLE_BACKEND_OPEN_ADDRESSING.
+ */
+typedef struct hashtable_u64_s hashtable_u64_t;
+
+/*
+ * Creates a new table of integer keys.
+ * Parameter "size" is the number of keys it can hold before growing.
+ * Parameter "value_delete_function" is used to free values, it can be NULL.
+ * Return: NULL if error, pointer to table on success.
+ */
+hashtable_u64_t *hashtable_u64_create(unsigned long size,
+                                      fp_delete value_delete_function);
+
+/*
+ * If the key doesn't exist in the table a new key-value pair is introduced,
+ * if it exists its value is replaced (the old one is freed with the value
+ * delete function). Parameter "value" can be NULL.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_u64_set(hashtable_u64_t *hashtable, uint64_t key, void *value);
+
+/*
+ * Gets the value associated to a key.
+ * Return: NULL if not found (or if the value is NULL), value on success.
+ */
+void *hashtable_u64_get(hashtable_u64_t *hashtable, uint64_t key);
+
+/*
+ * Deletes a key-value pair, freeing the value with the value delete function.
+ * Return: -1 on error, 0 on success (also if the key was not in the table).
+ */
+int hashtable_u64_delete_key(hashtable_u64_t *hashtable, uint64_t key);
+
+/*
+ * Return: Number of keys in the table, 0 if "hashtable" is NULL.
+ */
+unsigned long hashtable_u64_count(hashtable_u64_t *hashtable);
+
+/*
+ * Iterates over all key-value pairs, in no particular order. "*position"
+ * must be 0 in the first call, every call advances it. New keys can make the
+ * table grow, after which the iteration may miss or repeat keys. "key" and
+ * "value" can be NULL.
+ * Return: 1 if a pair was returned, 0 at the end.
+ */
+int hashtable_u64_next(hashtable_u64_t *hashtable, unsigned long *position,
+                       uint64_t *key, void **value);
+
+/*
+ * Frees all allocated memory in a table of integer keys, values with the
+ * value delete function.
+ */
+void hashtable_u64_delete(hashtable_u64_t *hashtable);
+
 #endif
@@ -0,0 +1,458 @@
+/*******************************************************************************
+ * Concurrent Hash Table implementation.
+ *
+ * License: MIT
+ * Github: github.com/adrian-bueno/hashtable
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "hashtable_concurrent.h"
+
+
+/**** DEFAULT OPTIONS *********************************************************/
+
+#define HASHTABLE_CONCURRENT_DEFAULT_SEGMENTS 64
+
+
+/**** STRUCTURES **************************************************************/
+
+/*
+ * Segments are padded to a cache line, so locking one segment does not slow
+ * down threads using the next one.
+ */
+struct hashsegment_s {
+    pthread_rwlock_t lock;
+    hashtable_t *table;
+} __attribute__((aligned(64)));
+
+/*
+ * Every segment uses the same hash function and seed, so a key is hashed
+ * once: its hash selects the segment ("shift" keeps the bits needed) and is
+ * passed to the *_hashed functions of the segment.
+ */
+struct hashtable_concurrent_s {
+    unsigned long segments_count;
+    unsigned int shift;
+    struct hashsegment_s *segments;
+};
+
+typedef struct hashsegment_s hashsegment_t;
+
+
+/**** CONCURRENT HASHTABLE FUNCTIONS ******************************************/
+
+/*
+ * Selects the segment of a hash value with Fibonacci hashing. It uses other
+ * bits than the bucket selection inside the segment.
+ * Return: Segment of the hash value.
+ */
+static hashsegment_t *hashtable_concurrent_segment(
+                          hashtable_concurrent_t *hashtable,
+                          unsigned long hash) {
+
+    uint64_t index;
+
+    if (hashtable->segments_count == 1)
+        return &hashtable->segments[0];
+
+    index = ((uint64_t) hash * UINT64_C(0x9e3779b97f4a7c15)) >>
+            hashtable->shift;
+
+    return &hashtable->segments[index];
+}
+
+/*
+ * Creates a new concurrent hash table.
+ * Return: NULL if error, pointer to concurrent hashtable on success.
+ */
+hashtable_concurrent_t *hashtable_concurrent_create(unsigned long size,
+                                       unsigned long segments,
+                                       fp_compare_keys compare_function,
+                                       fp_hashvalue hashvalue_function,
+                                       fp_delete key_delete_function,
+                                       fp_delete value_delete_function,
+                                       const hashtable_options_t *options) {
+
+    hashtable_concurrent_t *hashtable = NULL;
+    hashtable_options_t segment_options;
+    unsigned long max_entries;
+    size_t max_bytes;
+    unsigned long count = 1;
+    unsigned int bits = 0;
+    unsigned long i;
+
+    if (segments == 0)
+        segments = HASHTABLE_CONCURRENT_DEFAULT_SEGMENTS;
+
+    while (count < segments && bits < 16) {
+        count *= 2;
+        bits++;
+    }
+
+    if (options != NULL)
+        segment_options = *options;
+    else
+        hashtable_options_init(&segment_options);
+
+    // Every segment is a cache with its share of the limits, at least 1
+    max_entries = segment_options.max_entries;
+    max_bytes = segment_options.max_bytes;
+    if ((max_entries > 0 && max_entries < count) ||
+        (max_bytes > 0 && max_bytes < count))
+        return NULL;
+
+    hashtable = (hashtable_concurrent_t *)
+                malloc (sizeof(hashtable_concurrent_t));
+    if (hashtable == NULL)
+        return NULL;
+
+    // Allocated with padding to align the segments to a cache line
+    hashtable->segments = (hashsegment_t *)
+                          aligned_alloc(sizeof(hashsegment_t),
+                                        count * sizeof(hashsegment_t));
+    if (hashtable->segments == NULL) {
+        free(hashtable);
+        return NULL;
+    }
+
+    hashtable->segments_count = count;
+    hashtable->shift = 64 - bits;
+
+    size = size / count > 0 ? size / count : 1;
+
+    for (i = 0; i < count; i++) {
+        // The first segments take the remainder, so the shares add up to
+        // the limits
+        if (max_entries > 0)
+            segment_options.max_entries = max_entries / count +
+                                          (i < max_entries % count);
+        if (max_bytes > 0)
+            segment_options.max_bytes = max_bytes / count +
+                                        (i < max_bytes % count);
+
+        hashtable->segments[i].table = hashtable_create_with_options(size,
+                                           compare_function,
+                                           hashvalue_function,
+                                           key_delete_function,
+                                           value_delete_function,
+                                           &segment_options);
+        if (hashtable->segments[i].table == NULL ||
+            pthread_rwlock_init(&hashtable->segments[i].lock, NULL) != 0) {
+            hashtable_delete(hashtable->segments[i].table);
+            hashtable->segments_count = i;
+            hashtable_concurrent_delete(hashtable);
+            return NULL;
+        }
+
+        // All segments share the seed of the first one
+        if (i == 0)
+            segment_options.seed =
+                hashtable_seed(hashtable->segments[0].table);
+    }
+
+    return hashtable;
+}
+
+/*
+ * Same as hashtable_set(). Blocks other threads using the same segment.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_concurrent_set(hashtable_concurrent_t *hashtable, void *key,
+                             void *value) {
+
+    hashsegment_t *segment = NULL;
+    unsigned long hash;
+    int result;
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    hash = hashtable_hash_key(hashtable->segments[0].table, key);
+    segment = hashtable_concurrent_segment(hashtable, hash);
+
+    pthread_rwlock_wrlock(&segment->lock);
+    result = hashtable_set_hashed(segment->table, key, value, hash);
+    pthread_rwlock_unlock(&segment->lock);
+
+    return result;
+}
+
+/*
+ * Same as hashtable_set_if_absent(). Blocks other threads using the same
+ * segment.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_concurrent_set_if_absent(hashtable_concurrent_t *hashtable,
+                                       void *key, void *value) {
+
+    hashsegment_t *segment = NULL;
+    unsigned long hash;
+    int result;
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    hash = hashtable_hash_key(hashtable->segments[0].table, key);
+    segment = hashtable_concurrent_segment(hashtable, hash);
+
+    pthread_rwlock_wrlock(&segment->lock);
+    result = hashtable_set_if_absent_hashed(segment->table, key, value, hash);
+    pthread_rwlock_unlock(&segment->lock);
+
+    return result;
+}
+
+/*
+ * Same as hashtable_get(). Only waits for threads modifying the same segment.
+ * Return: NULL on error, value on success.
+ */
+void *hashtable_concurrent_get(hashtable_concurrent_t *hashtable, void *key) {
+
+    hashsegment_t *segment = NULL;
+    unsigned long hash;
+    void *value;
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    hash = hashtable_hash_key(hashtable->segments[0].table, key);
+    segment = hashtable_concurrent_segment(hashtable, hash);
+
+    // Readers share the lock, so the lookup must not advance a resize
+    pthread_rwlock_rdlock(&segment->lock);
+    value = hashtable_peek_hashed(segment->table, key, hash);
+    pthread_rwlock_unlock(&segment->lock);
+
+    return value;
+}
+
+/*
+ * Same as hashtable_delete_key(). Blocks other threads using the same segment.
+ * Return: -1 on error, 0 on success.
+ */
+int hashtable_concurrent_delete_key(hashtable_concurrent_t *hashtable,
+                                    void *key) {
+
+    hashsegment_t *segment = NULL;
+    unsigned long hash;
+    int result;
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    hash = hashtable_hash_key(hashtable->segments[0].table, key);
+    segment = hashtable_concurrent_segment(hashtable, hash);
+
+    pthread_rwlock_wrlock(&segment->lock);
+    result = hashtable_delete_key_hashed(segment->table, key, hash);
+    pthread_rwlock_unlock(&segment->lock);
+
+    return result;
+}
+
+/*
+ * Same as hashtable_take(). Blocks other threads using the same segment.
+ * Return: Value of the key, NULL if not found or on error.
+ */
+void *hashtable_concurrent_take(hashtable_concurrent_t *hashtable, void *key) {
+
+    hashsegment_t *segment = NULL;
+    unsigned long hash;
+    void *value;
+
+    if (hashtable == NULL || key == NULL)
+        return NULL;
+
+    hash = hashtable_hash_key(hashtable->segments[0].table, key);
+    segment = hashtable_concurrent_segment(hashtable, hash);
+
+    pthread_rwlock_wrlock(&segment->lock);
+    value = hashtable_take_hashed(segment->table, key, hash);
+    pthread_rwlock_unlock(&segment->lock);
+
+    return value;
+}
+
+/*
+ * Adds "delta" to the counter of a key. Existing keys are updated under the
+ * read lock of their segment, with an atomic fetch-add.
+ * Return: 1 if introduced, 0 if already there, -1 on error.
+ */
+int hashtable_concurrent_incr(hashtable_concurrent_t *hashtable, void *key,
+                              long delta, long *count) {
+
+    hashsegment_t *segment = NULL;
+    unsigned long hash;
+    int result;
+
+    if (hashtable == NULL || key == NULL)
+        return -1;
+
+    hash = hashtable_hash_key(hashtable->segments[0].table, key);
+    segment = hashtable_concurrent_segment(hashtable, hash);
+
+    pthread_rwlock_rdlock(&segment->lock);
+    result = hashtable_incr_shared_hashed(segment->table, key, delta, hash,
+                                          count);
+    pthread_rwlock_unlock(&segment->lock);
+
+    if (result == 0)
+        return 0;
+
+    // Another thread may introduce the key in between, then it is updated
+    pthread_rwlock_wrlock(&segment->lock);
+    result = hashtable_incr_hashed(segment->table, key, delta, hash, count);
+    pthread_rwlock_unlock(&segment->lock);
+
+    return result;
+}
+
+/*
+ * Finds the "k" keys with the largest counters: the top "k" of every segment
+ * are merged with the top "k" found so far.
+ * Return: Number of keys returned.
+ */
+unsigned long hashtable_concurrent_top_k(hashtable_concurrent_t *hashtable,
+                                         unsigned long k, void **keys,
+                                         long *counts) {
+
+    void **segment_keys = NULL;
+    long *segment_counts = NULL;
+    long *merged_counts = NULL;
+    void **merged_keys = NULL;
+    unsigned long count = 0;
+    unsigned long found;
+    unsigned long i, a, b, n;
+
+    if (hashtable == NULL || keys == NULL || counts == NULL || k == 0)
+        return 0;
+
+    segment_keys = (void **) malloc(2 * k * sizeof(void *));
+    segment_counts = (long *) malloc(2 * k * sizeof(long));
+    if (segment_keys == NULL || segment_counts == NULL) {
+        free(segment_keys);
+        free(segment_counts);
+        return 0;
+    }
+    merged_keys = segment_keys + k;
+    merged_counts = segment_counts + k;
+
+    for (i = 0; i < hashtable->segments_count; i++) {
+        pthread_rwlock_rdlock(&hashtable->segments[i].lock);
+        found = hashtable_top_k(hashtable->segments[i].table, k,
+                                segment_keys, segment_counts);
+        pthread_rwlock_unlock(&hashtable->segments[i].lock);
+
+        // Both lists go from the largest counter to the smallest
+        for (a = 0, b = 0, n = 0; n < k && (a < count || b < found); n++) {
+            if (b == found || (a < count && counts[a] >= segment_counts[b])) {
+                merged_keys[n] = keys[a];
+                merged_counts[n] = counts[a++];
+            }
+            else {
+                merged_keys[n] = segment_keys[b];
+                merged_counts[n] = segment_counts[b++];
+            }
+        }
+
+        memcpy(keys, merged_keys, n * sizeof(void *));
+        memcpy(counts, merged_counts, n * sizeof(long));
+        count = n;
+    }
+
+    free(segment_keys);
+    free(segment_counts);
+
+    return count;
+}
+
+/*
+ * Return: Number of keys in the table.
+ */
+unsigned long hashtable_concurrent_count(hashtable_concurrent_t *hashtable) {
+
+    unsigned long count = 0;
+    unsigned long i;
+
+    if (hashtable == NULL)
+        return 0;
+
+    for (i = 0; i < hashtable->segments_count; i++) {
+        pthread_rwlock_rdlock(&hashtable->segments[i].lock);
+        count += hashtable_count(hashtable->segments[i].table);
+        pthread_rwlock_unlock(&hashtable->segments[i].lock);
+    }
+
+    return count;
+}
+
+/*
+ * Adds up the statistics of all segments, reading one segment at a time.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_concurrent_stats(hashtable_concurrent_t *hashtable,
+                               hashtable_stats_t *stats) {
+
+    hashtable_stats_t segment;
+    unsigned long i, j;
+
+    if (hashtable == NULL || stats == NULL)
+        return -1;
+
+    memset(stats, 0, sizeof(hashtable_stats_t));
+
+    for (i = 0; i < hashtable->segments_count; i++) {
+        pthread_rwlock_rdlock(&hashtable->segments[i].lock);
+        hashtable_stats(hashtable->segments[i].table, &segment);
+        pthread_rwlock_unlock(&hashtable->segments[i].lock);
+
+        stats->count += segment.count;
+        stats->buckets += segment.buckets;
+        stats->empty_buckets += segment.empty_buckets;
+        for (j = 0; j < HASHTABLE_STATS_HISTOGRAM_SIZE; j++)
+            stats->chain_histogram[j] += segment.chain_histogram[j];
+        if (segment.max_chain > stats->max_chain)
+            stats->max_chain = segment.max_chain;
+        stats->tombstones += segment.tombstones;
+        stats->resizing |= segment.resizing;
+        stats->bucket_bytes += segment.bucket_bytes;
+        stats->node_bytes += segment.node_bytes;
+        stats->arena_bytes += segment.arena_bytes;
+        stats->cache_bytes += segment.cache_bytes;
+        stats->evictions += segment.evictions;
+        stats->expirations += segment.expirations;
+        stats->total_bytes += segment.total_bytes;
+        stats->lookups += segment.lookups;
+        stats->hits += segment.hits;
+        stats->misses += segment.misses;
+        stats->probes += segment.probes;
+    }
+
+    stats->total_bytes += sizeof(hashtable_concurrent_t) +
+                          hashtable->segments_count * sizeof(hashsegment_t);
+    hashtable_stats_ratios(stats);
+
+    return 0;
+}
+
+/*
+ * Frees all allocated memory in a concurrent hash table.
+ */
+void hashtable_concurrent_delete(hashtable_concurrent_t *hashtable) {
+
+    unsigned long i;
+
+    if (hashtable == NULL)
+        return;
+
+    for (i = 0; i < hashtable->segments_count; i++) {
+        hashtable_delete(hashtable->segments[i].table);
+        pthread_rwlock_destroy(&hashtable->segments[i].lock);
+    }
+
+    free(hashtable->segments);
+    free(hashtable);
+}
@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * Concurrent Hash Table.
+ *
+ * A hash table that several threads can use at the same time. Keys are split
+ * by hash value into segments, each one a hashtable_t protected by its own
+ * reader-writer lock: operations on different segments never wait for each
+ * other, and readers of the same segment never wait for each other. Every
+ * segment grows on its own (incrementally, see hashtable_options_t), so a
+ * resize only blocks writers of one segment for a few buckets at a time.
+ *
+ * License: MIT
+ * Github: github.com/adrian-bueno/hashtable
+ ******************************************************************************/
+
+#ifndef _HASHTABLE_CONCURRENT_H_
+#define _HASHTABLE_CONCURRENT_H_
+
+#include "hashtable.h"
+
+/*
+ * Concurrent hash table type.
+ */
+typedef struct hashtable_concurrent_s hashtable_concurrent_t;
+
+/*
+ * Creates a new concurrent hash table.
+ * Parameter "size" is the initial number of buckets of the whole table.
+ * Parameter "segments" is the number of independently locked segments, it is
+ * rounded up to a power of two. A few times the number of threads is a good
+ * value. 0 uses 64 segments.
+ * Parameters "compare_function", "hashvalue_function", "key_delete_function",
+ * "value_delete_function" and "options" are used to create every segment, as
+ * in hashtable_create_with_options(). The "max_entries" and "max_bytes" of a
+ * cache are split between segments, so they must be at least the number of
+ * segments, and every segment evicts on its own when it reaches its share:
+ * the whole cache can evict before it reaches the limits. Shares differ by
+ * at most 1 and add up to the limits. hashtable_concurrent_get() does not
+ * mark keys as used, so a concurrent cache evicts in insertion order.
+ * Return: NULL if error (also if a limit is smaller than the number of
+ * segments), pointer to concurrent hashtable on success.
+ */
+hashtable_concurrent_t *hashtable_concurrent_create(unsigned long size,
+                                       unsigned long segments,
+                                       fp_compare_keys compare_function,
+                                       fp_hashvalue hashvalue_function,
+                                       fp_delete key_delete_function,
+                                       fp_delete value_delete_function,
+                                       const hashtable_options_t *options);
+
+/*
+ * Same as hashtable_set(). Blocks other threads using the same segment.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_concurrent_set(hashtable_concurrent_t *hashtable, void *key,
+                             void *value);
+
+/*
+ * Same as hashtable_set_if_absent(). Blocks other threads using the same
+ * segment. Several threads can race to introduce the same key: exactly one of
+ * them gets 1.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_concurrent_set_if_absent(hashtable_concurrent_t *hashtable,
+                                       void *key, void *value);
+
+/*
+ * Same as hashtable_get(). Only waits for threads modifying the same segment.
+ * If other threads can replace or delete the key while the value is used, the
+ * table must not have a value delete function, or the value may be freed
+ * while in use.
+ * Return: NULL on error, value on success.
+ */
+void *hashtable_concurrent_get(hashtable_concurrent_t *hashtable, void *key);
+
+/*
+ * Same as hashtable_delete_key(). Blocks other threads using the same segment.
+ * Return: -1 on error, 0 on success.
+ */
+int hashtable_concurrent_delete_key(hashtable_concurrent_t *hashtable,
+                                    void *key);
+
+/*
+ * Same as hashtable_take(). Blocks other threads using the same segment.
+ * Only one of several threads taking the same key gets its value.
+ * Return: Value of the key, NULL if not found or on error.
+ */
+void *hashtable_concurrent_take(hashtable_concurrent_t *hashtable, void *key);
+
+/*
+ * Same as hashtable_incr(). A key already in the table is updated under the
+ * read lock of its segment with an atomic fetch-add, so threads counting the
+ * same keys never wait for each other; only new keys take the write lock.
+ * hashtable_concurrent_get() and hashtable_concurrent_top_k() read counters
+ * with relaxed atomic loads, so while other threads update them they see
+ * each counter at some recent value.
+ * Return: 1 if introduced, 0 if the key was already in the table, -1 on error.
+ */
+int hashtable_concurrent_incr(hashtable_concurrent_t *hashtable, void *key,
+                              long delta, long *count);
+
+/*
+ * Same as hashtable_top_k(), over all segments. Every segment is read under
+ * its read lock, one after another, so counting threads are not blocked. If
+ * other threads can delete keys, the returned keys may be freed while in use.
+ * Return: Number of keys returned, less than "k" if the table has less keys.
+ */
+unsigned long hashtable_concurrent_top_k(hashtable_concurrent_t *hashtable,
+                                         unsigned long k, void **keys,
+                                         long *counts);
+
+/*
+ * Return: Number of keys in the table. With other threads modifying the
+ * table it is only an approximation.
+ */
+unsigned long hashtable_concurrent_count(hashtable_concurrent_t *hashtable);
+
+/*
+ * Same as hashtable_stats(), adding up the statistics of all segments. Every
+ * segment is read under its read lock, one after another, so with other
+ * threads modifying the table the result mixes different moments. Lookup
+ * counters ("counters" option) of segments read by several threads at once
+ * may miss some lookups.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_concurrent_stats(hashtable_concurrent_t *hashtable,
+                               hashtable_stats_t *stats);
+
+/*
+ * Frees all allocated memory in a concurrent hash table. No other thread can
+ * be using it.
+ */
+void hashtable_concurrent_delete(hashtable_concurrent_t *hashtable);
+
+#endif
@@ -0,0 +1,246 @@
+/*******************************************************************************
+ * Open Addressing Groups.
+ *
+ * Control bytes and probing shared by every open addressing table: the
+ * HASHTABLE_BACKEND_OPEN_ADDRESSING backend and hashtable_u64_t of
+ * hashtable.c, and the typed tables of hashtable_typed.h.
+ *
+ * A table has a power of two number of slots, a multiple of
+ * HASHTABLE_GROUP_WIDTH, and one control byte per slot. Slots are grouped in
+ * groups of HASHTABLE_GROUP_WIDTH slots whose control bytes are checked at
+ * once (with SSE2 when available). The mixed hash value of a key chooses its
+ * first group (low bits) and its control byte (7 high bits), and lookups
+ * visit the groups in triangular order until one has an empty slot.
+ *
+ * License: MIT
+ * Github: github.com/adrian-bueno/hashtable
+ ******************************************************************************/
+
+#ifndef _HASHTABLE_GROUP_H_
+#define _HASHTABLE_GROUP_H_
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/**** OPEN ADDRESSING CONSTANTS ***********************************************/
+
+/*
+ * A control byte is HASHTABLE_CTRL_EMPTY, HASHTABLE_CTRL_DELETED (tombstone)
+ * or, for a used slot, 7 bits of the hash of its key (always >= 0).
+ */
+#define HASHTABLE_GROUP_WIDTH  16
+#define HASHTABLE_CTRL_EMPTY   ((signed char) -128)
+#define HASHTABLE_CTRL_DELETED ((signed char) -2)
+
+/*
+ * Maximum fraction of used slots (keys plus tombstones) in an open addressing
+ * table, as a numerator over 8.
+ */
+#define HASHTABLE_OA_MAX_LOAD_EIGHTHS 7
+
+
+/**** OPEN ADDRESSING TYPES ***************************************************/
+
+/*
+ * Position of a lookup in its sequence of groups. "offset" is the first slot
+ * of the current group.
+ */
+typedef struct hashprobe_s {
+    unsigned long offset;
+    unsigned long group;
+    unsigned long groups_mask;
+    unsigned long step;
+} hashprobe_t;
+
+
+/**** GROUP FUNCTIONS *********************************************************/
+
+/*
+ * Return: Index of the lowest bit set in "mask", which cannot be 0.
+ */
+static inline unsigned int hashgroup_first(unsigned int mask) {
+
+#if defined(__GNUC__)
+    return (unsigned int) __builtin_ctz(mask);
+#else
+    unsigned int i = 0;
+
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/*
+ * Compares the control bytes of a group with "value".
+ * Return: Bit mask with bit i set if control byte i is equal to "value".
+ */
+static inline unsigned int hashgroup_match(const signed char *ctrl,
+                                           signed char value) {
+
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return (unsigned int) _mm_movemask_epi8(
+               _mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < HASHTABLE_GROUP_WIDTH; i++)
+        if (ctrl[i] == value)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+/*
+ * Finds the free (empty or deleted) slots of a group.
+ * Return: Bit mask with bit i set if slot i is free.
+ */
+static inline unsigned int hashgroup_match_free(const signed char *ctrl) {
+
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return (unsigned int) _mm_movemask_epi8(group);
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < HASHTABLE_GROUP_WIDTH; i++)
+        if (ctrl[i] < 0)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+/*
+ * Return: Control byte of a key with mixed hash value "mixed".
+ */
+static inline signed char hashgroup_h2(uint64_t mixed) {
+
+    return (signed char) (mixed >> 57);
+}
+
+/*
+ * Starts the lookup of a key with mixed hash value "mixed" in a table of
+ * "size" slots, at its first group.
+ */
+static inline void hashprobe_start(hashprobe_t *probe, uint64_t mixed,
+                                   unsigned long size) {
+
+    probe->groups_mask = size / HASHTABLE_GROUP_WIDTH - 1;
+    probe->group = (unsigned long) mixed & probe->groups_mask;
+    probe->offset = probe->group * HASHTABLE_GROUP_WIDTH;
+    probe->step = 0;
+}
+
+/*
+ * Moves a lookup to its next group. Triangular probing visits every group
+ * once.
+ * Return: 1 if there is a next group, 0 if every group was visited.
+ */
+static inline int hashprobe_next(hashprobe_t *probe) {
+
+    probe->step++;
+    probe->group = (probe->group + probe->step) & probe->groups_mask;
+    probe->offset = probe->group * HASHTABLE_GROUP_WIDTH;
+
+    return probe->step <= probe->groups_mask;
+}
+
+/*
+ * Finds a free slot for a key that is not in a table of "size" slots and
+ * marks it as used, updating the number of tombstones of the table. The
+ * table must have at least one free slot.
+ * Return: Slot index.
+ */
+static inline unsigned long hashgroup_claim(signed char *ctrl,
+                                            unsigned long size,
+                                            uint64_t mixed,
+                                            unsigned long *tombstones) {
+
+    hashprobe_t probe;
+    unsigned long slot = 0;
+    unsigned int mask;
+
+    hashprobe_start(&probe, mixed, size);
+    do {
+        mask = hashgroup_match_free(ctrl + probe.offset);
+        if (mask != 0) {
+            slot = probe.offset + hashgroup_first(mask);
+            break;
+        }
+    } while (hashprobe_next(&probe));
+
+    if (ctrl[slot] == HASHTABLE_CTRL_DELETED)
+        (*tombstones)--;
+    ctrl[slot] = hashgroup_h2(mixed);
+
+    return slot;
+}
+
+/*
+ * Marks a used slot as free, updating the number of tombstones of the table.
+ */
+static inline void hashgroup_erase(signed char *ctrl, unsigned long slot,
+                                   unsigned long *tombstones) {
+
+    const signed char *group;
+
+    /*
+     * A lookup never goes past a group with an empty slot, so if the group
+     * already has one the slot can be emptied instead of leaving a tombstone.
+     */
+    group = ctrl + slot / HASHTABLE_GROUP_WIDTH * HASHTABLE_GROUP_WIDTH;
+    if (hashgroup_match(group, HASHTABLE_CTRL_EMPTY) != 0) {
+        ctrl[slot] = HASHTABLE_CTRL_EMPTY;
+    }
+    else {
+        ctrl[slot] = HASHTABLE_CTRL_DELETED;
+        (*tombstones)++;
+    }
+}
+
+/*
+ * Return: Smallest number of slots of a table that holds "count" keys
+ * without growing.
+ */
+static inline unsigned long hashgroup_slots(unsigned long count) {
+
+    unsigned long slots = HASHTABLE_GROUP_WIDTH;
+
+    while (slots / 8 * HASHTABLE_OA_MAX_LOAD_EIGHTHS < count &&
+           slots * 2 > slots)
+        slots *= 2;
+
+    return slots;
+}
+
+/*
+ * Checks if a table of "size" slots, "count" keys and "tombstones" must be
+ * resized before a new key is introduced, "limit" being the maximum number
+ * of used slots.
+ * Return: 0 if the key fits, new number of slots otherwise: twice "size", or
+ * "size" to only remove tombstones when they are most of the used slots.
+ */
+static inline unsigned long hashgroup_resize_size(unsigned long size,
+                                                  unsigned long count,
+                                                  unsigned long tombstones,
+                                                  unsigned long limit) {
+
+    if (count + tombstones + 1 <= limit)
+        return 0;
+
+    if (count + 1 > limit / 2 && size * 2 > size)
+        size *= 2;
+
+    return size;
+}
+
+#endif
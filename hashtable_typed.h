@@ -0,0 +1,306 @@
+/*******************************************************************************
+ * Typed Hash Table.
+ *
+ * Header-only hash tables generated for one key type and one value type:
+ *
+ *     HASHTABLE_DEFINE(name, key_t, value_t, hash_function, equal_function)
+ *
+ * defines the type name_t and the functions below, all "static inline", so
+ * the hash and equality functions are inlined into the lookups instead of
+ * being called through pointers. Keys and values are stored by value in the
+ * slots of the table (copied by assignment), so an integer keyed table never
+ * follows a pointer to compare keys.
+ *
+ * The tables use the open addressing layout and probing of
+ * HASHTABLE_BACKEND_OPEN_ADDRESSING, from hashtable_group.h (groups of 16
+ * slots with one control byte per slot, checked at once with SSE2 when
+ * available, at most 7/8 of the slots used).
+ *
+ * Parameter "hash_function" is called as hash_function(key) and returns an
+ * unsigned long. It does not need to mix its bits, the table does it.
+ * Parameter "equal_function" is called as equal_function(key1, key2) and
+ * returns not 0 if the keys are equal. Both can be functions or macros.
+ *
+ * Generated functions:
+ *
+ * name_t *name_create(unsigned long size)
+ *     Creates a table with room for "size" keys before growing.
+ *     Return: NULL if error, pointer to table on success.
+ * void name_delete(name_t *table)
+ *     Frees the table. Keys and values are not freed.
+ * int name_set(name_t *table, key_t key, value_t value)
+ *     Introduces a new key-value pair or replaces the value of a key.
+ *     Return: 0 on success, -1 on error.
+ * value_t *name_get(name_t *table, key_t key)
+ *     Return: pointer to the value of the key inside the table (valid until
+ *     the next name_set() or name_delete_key()), NULL if not found.
+ * int name_delete_key(name_t *table, key_t key)
+ *     Return: 0 on success (also if the key was not in the table).
+ * unsigned long name_count(name_t *table)
+ *     Return: Number of keys in the table.
+ * int name_next(name_t *table, unsigned long *position, key_t *key,
+ *               value_t *value)
+ *     Iterates over all key-value pairs: "*position" starts at 0 and is
+ *     advanced by every call. "key" and "value" can be NULL.
+ *     Return: 1 if a pair was returned, 0 at the end.
+ *
+ * Example:
+ *
+ *     HASHTABLE_DEFINE(counts, unsigned long, int, hashtable_typed_hash_int,
+ *                      hashtable_typed_equal_int)
+ *
+ *     counts_t *table = counts_create(1024);
+ *     counts_set(table, 42, 1);
+ *     (*counts_get(table, 42))++;
+ *
+ * License: MIT
+ * Github: github.com/adrian-bueno/hashtable
+ ******************************************************************************/
+
+#ifndef _HASHTABLE_TYPED_H_
+#define _HASHTABLE_TYPED_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "hashtable_group.h"
+
+
+/**** HASH FUNCTIONS **********************************************************/
+
+/*
+ * MurmurHash3 finalizer: every bit of the hash value affects the slot and
+ * the control byte.
+ */
+static inline uint64_t hashtable_typed_mix(uint64_t hash) {
+
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xc4ceb9fe1a85ec53);
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+
+/**** KEY FUNCTIONS ***********************************************************/
+
+/*
+ * Hash and equality of integer keys (any integer type).
+ */
+#define hashtable_typed_hash_int(key)       ((unsigned long) (key))
+#define hashtable_typed_equal_int(key1, key2) ((key1) == (key2))
+
+/*
+ * Hash and equality of C string keys ("const char *" or "char *"). The table
+ * stores the pointers, the strings must live as long as they are keys.
+ */
+static inline unsigned long hashtable_typed_hash_string(const char *key) {
+
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+    // FNV-1a, short keys do not pay for the setup of a block hash
+    while (*key != '\0') {
+        hash ^= (unsigned char) *key++;
+        hash *= UINT64_C(0x100000001b3);
+    }
+
+    return (unsigned long) hash;
+}
+
+#define hashtable_typed_equal_string(key1, key2) (strcmp((key1), (key2)) == 0)
+
+
+/**** TABLE GENERATOR *********************************************************/
+
+/*
+ * Defines the table type name_t and its functions. See the top of the file.
+ */
+#define HASHTABLE_DEFINE(name, key_t, value_t, hash_function, equal_function) \
+                                                                               \
+typedef struct name##_slot_s {                                                 \
+    key_t key;                                                                 \
+    value_t value;                                                             \
+} name##_slot_t;                                                               \
+                                                                               \
+typedef struct name##_s {                                                      \
+    signed char *ctrl;                                                         \
+    name##_slot_t *slots;                                                      \
+    unsigned long size;                                                        \
+    unsigned long count;                                                       \
+    unsigned long tombstones;                                                  \
+} name##_t;                                                                    \
+                                                                               \
+static inline int name##_alloc(name##_t *table, unsigned long size) {          \
+                                                                               \
+    table->ctrl = (signed char *) malloc (size);                               \
+    table->slots = (name##_slot_t *) malloc (size * sizeof(name##_slot_t));    \
+    if (table->ctrl == NULL || table->slots == NULL) {                         \
+        free(table->ctrl);                                                     \
+        free(table->slots);                                                    \
+        return -1;                                                             \
+    }                                                                          \
+                                                                               \
+    memset(table->ctrl, HASHTABLE_CTRL_EMPTY, size);                           \
+    table->size = size;                                                        \
+    table->tombstones = 0;                                                     \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline name##_t *name##_create(unsigned long size) {                    \
+                                                                               \
+    name##_t *table = NULL;                                                    \
+                                                                               \
+    table = (name##_t *) malloc (sizeof(name##_t));                            \
+    if (table == NULL)                                                         \
+        return NULL;                                                           \
+                                                                               \
+    if (name##_alloc(table, hashgroup_slots(size)) != 0) {                     \
+        free(table);                                                           \
+        return NULL;                                                           \
+    }                                                                          \
+    table->count = 0;                                                          \
+                                                                               \
+    return table;                                                              \
+}                                                                              \
+                                                                               \
+static inline void name##_delete(name##_t *table) {                            \
+                                                                               \
+    if (table == NULL)                                                         \
+        return;                                                                \
+                                                                               \
+    free(table->ctrl);                                                         \
+    free(table->slots);                                                        \
+    free(table);                                                               \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_find(name##_t *table, key_t key,            \
+                                        uint64_t mixed) {                      \
+                                                                               \
+    signed char h2 = hashgroup_h2(mixed);                                      \
+    hashprobe_t probe;                                                         \
+    unsigned long slot;                                                        \
+    unsigned int mask;                                                         \
+    const signed char *ctrl;                                                   \
+                                                                               \
+    hashprobe_start(&probe, mixed, table->size);                               \
+    do {                                                                       \
+        ctrl = table->ctrl + probe.offset;                                     \
+                                                                               \
+        for (mask = hashgroup_match(ctrl, h2); mask != 0; mask &= mask - 1) {  \
+            slot = probe.offset + hashgroup_first(mask);                       \
+            if (equal_function(key, table->slots[slot].key))                   \
+                return slot;                                                   \
+        }                                                                      \
+                                                                               \
+        if (hashgroup_match(ctrl, HASHTABLE_CTRL_EMPTY) != 0)                  \
+            break;                                                             \
+    } while (hashprobe_next(&probe));                                          \
+                                                                               \
+    return table->size;                                                        \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_claim(name##_t *table, uint64_t mixed) {    \
+                                                                               \
+    return hashgroup_claim(table->ctrl, table->size, mixed,                    \
+                           &table->tombstones);                                \
+}                                                                              \
+                                                                               \
+static inline int name##_resize(name##_t *table, unsigned long size) {         \
+                                                                               \
+    name##_t old = *table;                                                     \
+    unsigned long i, slot;                                                     \
+                                                                               \
+    if (name##_alloc(table, size) != 0) {                                      \
+        *table = old;                                                          \
+        return -1;                                                             \
+    }                                                                          \
+                                                                               \
+    for (i = 0; i < old.size; i++) {                                           \
+        if (old.ctrl[i] < 0)                                                   \
+            continue;                                                          \
+        slot = name##_claim(table, hashtable_typed_mix(                        \
+                                       hash_function(old.slots[i].key)));      \
+        table->slots[slot] = old.slots[i];                                     \
+    }                                                                          \
+                                                                               \
+    free(old.ctrl);                                                            \
+    free(old.slots);                                                           \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline int name##_set(name##_t *table, key_t key, value_t value) {      \
+                                                                               \
+    uint64_t mixed = hashtable_typed_mix(hash_function(key));                  \
+    unsigned long slot, size = table->size;                                    \
+                                                                               \
+    slot = name##_find(table, key, mixed);                                     \
+    if (slot < size) {                                                         \
+        table->slots[slot].value = value;                                      \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    size = hashgroup_resize_size(size, table->count, table->tombstones,        \
+                                 size / 8 * HASHTABLE_OA_MAX_LOAD_EIGHTHS);    \
+    if (size != 0 && name##_resize(table, size) != 0 &&                        \
+        table->count + table->tombstones >= table->size)                       \
+        return -1;                                                             \
+                                                                               \
+    slot = name##_claim(table, mixed);                                         \
+    table->slots[slot].key = key;                                              \
+    table->slots[slot].value = value;                                          \
+    table->count++;                                                            \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline value_t *name##_get(name##_t *table, key_t key) {                \
+                                                                               \
+    unsigned long slot;                                                        \
+                                                                               \
+    slot = name##_find(table, key, hashtable_typed_mix(hash_function(key)));   \
+    if (slot == table->size)                                                   \
+        return NULL;                                                           \
+                                                                               \
+    return &table->slots[slot].value;                                          \
+}                                                                              \
+                                                                               \
+static inline int name##_delete_key(name##_t *table, key_t key) {              \
+                                                                               \
+    unsigned long slot;                                                        \
+                                                                               \
+    slot = name##_find(table, key, hashtable_typed_mix(hash_function(key)));   \
+    if (slot == table->size)                                                   \
+        return 0;                                                              \
+                                                                               \
+    hashgroup_erase(table->ctrl, slot, &table->tombstones);                    \
+    table->count--;                                                            \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_count(name##_t *table) {                    \
+                                                                               \
+    return table->count;                                                       \
+}                                                                              \
+                                                                               \
+static inline int name##_next(name##_t *table, unsigned long *position,        \
+                              key_t *key, value_t *value) {                    \
+                                                                               \
+    for (; *position < table->size; (*position)++) {                           \
+        if (table->ctrl[*position] < 0)                                        \
+            continue;                                                          \
+        if (key != NULL)                                                       \
+            *key = table->slots[*position].key;                                \
+        if (value != NULL)                                                     \
+            *value = table->slots[*position].value;                            \
+        (*position)++;                                                         \
+        return 1;                                                              \
+    }                                                                          \
+                                                                               \
+    return 0;                                                                  \
+}
+
+#endif
@@ -0,0 +1,1038 @@
+/*******************************************************************************
+ * Hash Table with a Write-Ahead Log implementation.
+ *
+ * License: MIT
+ * Github: github.com/adrian-bueno/hashtable
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashtable_wal.h"
+
+
+/**** DEFAULT OPTIONS *********************************************************/
+
+#define HASHTABLE_WAL_DEFAULT_SYNC_INTERVAL 1000
+#define HASHTABLE_WAL_DEFAULT_BATCH_BYTES   (64UL << 10)
+#define HASHTABLE_WAL_DEFAULT_COMPACT_BYTES (64UL << 20)
+#define HASHTABLE_WAL_MAX_THREADS           256
+
+
+/**** STRUCTURES **************************************************************/
+
+/*
+ * Log file: the header and the records, each one followed by its key and
+ * value bytes, both padded to 8 bytes. "checksum" covers the rest of the
+ * record and the key and value bytes, so a record partially written by a
+ * crash is detected and ends the log. Numbers are in the byte order of the
+ * machine that wrote the file, "byte_order" is HASHWAL_BYTE_ORDER in that
+ * order.
+ */
+#define HASHWAL_MAGIC       "HTWAL001"
+#define HASHWAL_BYTE_ORDER  UINT64_C(0x0102030405060708)
+#define HASHWAL_NULL_VALUE  UINT64_MAX
+#define HASHWAL_SET         1
+#define HASHWAL_DELETE      2
+
+struct hashwal_header_s {
+    char magic[8];
+    uint64_t byte_order;
+};
+
+struct hashwal_record_s {
+    uint32_t checksum;
+    uint32_t type;
+    uint64_t key_length;
+    uint64_t value_length;
+};
+
+/*
+ * Change read from the snapshot or the log, replayed when the table is
+ * opened.
+ */
+struct hashwal_item_s {
+    void *key;
+    void *value;
+    unsigned long hash;
+    int type;
+};
+
+/*
+ * Changes are appended to "buffer" under "lock". A commit takes the buffer
+ * (swapping it with "spare") and writes it without the lock, so threads keep
+ * appending changes meanwhile; "committing" is set while it writes, and
+ * threads that commit meanwhile wait on "committed" for the next batch.
+ * "appended" and "written" count records. "table_lock" protects the table:
+ * changes hold it while they are applied and appended, so the log has the
+ * changes of a key in the same order as the table. "compact_lock" lets one
+ * compaction at a time save the snapshot.
+ */
+struct hashtable_wal_s {
+    hashtable_t *table;
+    pthread_rwlock_t table_lock;
+    pthread_mutex_t compact_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t committed;
+    char *buffer;
+    size_t buffer_used;
+    size_t buffer_size;
+    char *spare;
+    size_t spare_size;
+    unsigned long appended;
+    unsigned long written;
+    int committing;
+    int failed;
+    int fd;
+    size_t log_bytes;
+    uint64_t last_sync;
+    char *path;
+    char *snapshot_path;
+    fp_length key_length;
+    fp_length value_length;
+    hashtable_wal_options_t options;
+};
+
+/*
+ * Replay of the changes into "tables", one per thread (or only the final
+ * one with a single thread). Phase 0 hashes the keys of a range of changes,
+ * phase 1 applies the changes of the keys of a thread in order.
+ */
+struct hashwal_replay_s {
+    struct hashtable_wal_s *wal;
+    struct hashwal_item_s *items;
+    unsigned long count;
+    hashtable_t **tables;
+    unsigned int threads;
+    int phase;
+};
+
+struct hashwal_worker_s {
+    struct hashwal_replay_s *replay;
+    unsigned int id;
+    int result;
+};
+
+typedef struct hashwal_header_s hashwal_header_t;
+typedef struct hashwal_record_s hashwal_record_t;
+typedef struct hashwal_item_s hashwal_item_t;
+typedef struct hashwal_replay_s hashwal_replay_t;
+typedef struct hashwal_worker_s hashwal_worker_t;
+
+
+/**** LOG FUNCTIONS ***********************************************************/
+
+/*
+ * Return: Length of a C string including the null character.
+ */
+static size_t hashtable_wal_string_length(void *string) {
+
+    return strlen((char *) string) + 1;
+}
+
+/*
+ * Compares C string keys, when no compare function is given.
+ */
+static int hashtable_wal_string_compare(void *key1, void *key2) {
+
+    return strcmp((char *) key1, (char *) key2);
+}
+
+/*
+ * Return: Milliseconds of a monotonic clock.
+ */
+static uint64_t hashtable_wal_now(void) {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/*
+ * Return: Bytes of a record with its key and value.
+ */
+static size_t hashtable_wal_record_bytes(uint64_t key_length,
+                                         uint64_t value_length) {
+
+    size_t bytes = sizeof(hashwal_record_t) + (key_length + 7) / 8 * 8;
+
+    if (value_length != HASHWAL_NULL_VALUE)
+        bytes += (value_length + 7) / 8 * 8;
+
+    return bytes;
+}
+
+/*
+ * Return: Checksum of a record whose key and value bytes follow it.
+ */
+static uint32_t hashtable_wal_checksum(const hashwal_record_t *record) {
+
+    const char *data = (const char *) (record + 1);
+    unsigned long hash;
+
+    hash = bytes_hash_value(&record->type, sizeof(hashwal_record_t) -
+                            sizeof(uint32_t), 0);
+    hash = bytes_hash_value(data, record->key_length, hash);
+    if (record->value_length != HASHWAL_NULL_VALUE)
+        hash = bytes_hash_value(data + (record->key_length + 7) / 8 * 8,
+                                record->value_length, hash);
+
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+/*
+ * Writes "length" bytes to a file descriptor, retrying partial writes.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_write(int fd, const char *data, size_t length) {
+
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, data, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return -1;
+        data += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+/*
+ * Return: Copy of "length" bytes allocated with malloc, NULL on error.
+ */
+static void *hashtable_wal_copy(const void *data, size_t length) {
+
+    void *copy = malloc (length > 0 ? length : 1);
+
+    if (copy != NULL)
+        memcpy(copy, data, length);
+
+    return copy;
+}
+
+/*
+ * Introduces or replaces a key-value pair in a table of the log, which owns
+ * copies of its keys and values freed with free().
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_apply_set(hashtable_wal_t *wal, hashtable_t *table,
+                                   void *key, void *value,
+                                   unsigned long hash) {
+
+    void *key_copy = NULL;
+    void *value_copy = NULL;
+    void **slot = NULL;
+    int inserted;
+
+    key_copy = hashtable_wal_copy(key, wal->key_length(key));
+    if (value != NULL)
+        value_copy = hashtable_wal_copy(value, wal->value_length(value));
+    if (key_copy == NULL || (value != NULL && value_copy == NULL))
+        goto error;
+
+    slot = hashtable_upsert_hashed(table, key_copy, hash, &inserted);
+    if (slot == NULL)
+        goto error;
+
+    // A key already in the table keeps its copy
+    if (!inserted) {
+        free(key_copy);
+        free(*slot);
+    }
+    *slot = value_copy;
+
+    return 0;
+
+error:
+    free(key_copy);
+    free(value_copy);
+    return -1;
+}
+
+/*
+ * Syncs the directory of the log, so the log created in it survives a crash
+ * of the system.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_sync_directory(hashtable_wal_t *wal) {
+
+    char *directory = strdup(wal->path);
+    char *slash = NULL;
+    int fd;
+    int result = -1;
+
+    if (directory == NULL)
+        return -1;
+
+    slash = strrchr(directory, '/');
+    if (slash == NULL)
+        strcpy(directory, ".");
+    else if (slash == directory)
+        directory[1] = '\0';
+    else
+        *slash = '\0';
+
+    fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        result = fsync(fd);
+        close(fd);
+    }
+
+    free(directory);
+    return result;
+}
+
+/*
+ * Appends a record to the buffer of a log. The log lock must be held.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_append(hashtable_wal_t *wal, int type, void *key,
+                                void *value) {
+
+    hashwal_record_t *record = NULL;
+    uint64_t key_length = wal->key_length(key);
+    uint64_t value_length = value != NULL ? wal->value_length(value)
+                                          : HASHWAL_NULL_VALUE;
+    size_t bytes = hashtable_wal_record_bytes(key_length, value_length);
+    size_t size;
+    char *buffer = NULL;
+    char *data = NULL;
+
+    if (wal->buffer_used + bytes > wal->buffer_size) {
+        size = wal->buffer_size > 0 ? wal->buffer_size : 4096;
+        while (size < wal->buffer_used + bytes)
+            size *= 2;
+        buffer = (char *) realloc (wal->buffer, size);
+        if (buffer == NULL)
+            return -1;
+        wal->buffer = buffer;
+        wal->buffer_size = size;
+    }
+
+    // Padding is zeroed, so the log does not depend on old buffer contents
+    record = (hashwal_record_t *) (wal->buffer + wal->buffer_used);
+    memset(record, 0, bytes);
+    record->type = type;
+    record->key_length = key_length;
+    record->value_length = value_length;
+
+    data = (char *) (record + 1);
+    memcpy(data, key, key_length);
+    if (value != NULL)
+        memcpy(data + (key_length + 7) / 8 * 8, value, value_length);
+
+    record->checksum = hashtable_wal_checksum(record);
+
+    wal->buffer_used += bytes;
+    wal->appended++;
+
+    return 0;
+}
+
+/*
+ * Removes the last record appended, with the same key and value, from the
+ * buffer. "lock" must be held since it was appended.
+ */
+static void hashtable_wal_unappend(hashtable_wal_t *wal, void *key,
+                                   void *value) {
+
+    wal->buffer_used -= hashtable_wal_record_bytes(
+                            wal->key_length(key),
+                            value != NULL ? wal->value_length(value)
+                                          : HASHWAL_NULL_VALUE);
+    wal->appended--;
+}
+
+/*
+ * Writes the buffered records to the log and syncs it as the options say,
+ * or always if "sync" is not 0. If another thread is writing, waits for it
+ * and writes the records appended meanwhile.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_flush(hashtable_wal_t *wal, int sync) {
+
+    unsigned long target, batch;
+    size_t bytes, size;
+    char *buffer = NULL;
+    uint64_t now;
+    int result;
+
+    pthread_mutex_lock(&wal->lock);
+
+    target = wal->appended;
+
+    while (!wal->failed && (wal->written < target || sync)) {
+        if (wal->committing) {
+            pthread_cond_wait(&wal->committed, &wal->lock);
+            continue;
+        }
+
+        // This thread writes the records of all waiting threads
+        buffer = wal->buffer;
+        size = wal->buffer_size;
+        bytes = wal->buffer_used;
+        batch = wal->appended;
+        wal->buffer = wal->spare;
+        wal->buffer_size = wal->spare_size;
+        wal->buffer_used = 0;
+        wal->committing = 1;
+
+        pthread_mutex_unlock(&wal->lock);
+
+        now = hashtable_wal_now();
+        result = hashtable_wal_write(wal->fd, buffer, bytes);
+        if (result == 0 &&
+            (sync || wal->options.sync == HASHTABLE_WAL_SYNC_COMMIT ||
+             (wal->options.sync == HASHTABLE_WAL_SYNC_INTERVAL &&
+              now - wal->last_sync >= wal->options.sync_interval))) {
+            result = fdatasync(wal->fd);
+            wal->last_sync = now;
+        }
+
+        pthread_mutex_lock(&wal->lock);
+
+        wal->spare = buffer;
+        wal->spare_size = size;
+        wal->committing = 0;
+        if (result != 0)
+            wal->failed = 1;
+        else {
+            wal->written = batch;
+            wal->log_bytes += bytes;
+        }
+        sync = 0;
+        pthread_cond_broadcast(&wal->committed);
+    }
+
+    result = wal->failed ? -1 : 0;
+
+    pthread_mutex_unlock(&wal->lock);
+
+    return result;
+}
+
+
+/**** REPLAY FUNCTIONS ********************************************************/
+
+/*
+ * Adds a change to the array of changes to replay.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_add_item(hashwal_item_t **items,
+                                  unsigned long *count,
+                                  unsigned long *size, int type, void *key,
+                                  void *value) {
+
+    hashwal_item_t *resized = NULL;
+
+    if (*count == *size) {
+        *size = *size > 0 ? *size * 2 : 1024;
+        resized = (hashwal_item_t *) realloc (*items, *size *
+                                              sizeof(hashwal_item_t));
+        if (resized == NULL)
+            return -1;
+        *items = resized;
+    }
+
+    (*items)[*count].type = type;
+    (*items)[*count].key = key;
+    (*items)[*count].value = value;
+    (*count)++;
+
+    return 0;
+}
+
+/*
+ * Reads the records of a mapped log up to the first incomplete or damaged
+ * one.
+ * Return: Bytes of the log that are complete records (with the header), 0 if
+ * the file is not a log, (size_t) -1 on error.
+ */
+static size_t hashtable_wal_read_log(const char *map, size_t size,
+                                     hashwal_item_t **items,
+                                     unsigned long *count,
+                                     unsigned long *items_size) {
+
+    const hashwal_header_t *header = (const hashwal_header_t *) map;
+    const hashwal_record_t *record = NULL;
+    size_t offset = sizeof(hashwal_header_t);
+    size_t bytes;
+    char *data = NULL;
+
+    if (size < sizeof(hashwal_header_t) ||
+        memcmp(header->magic, HASHWAL_MAGIC, sizeof(header->magic)) != 0 ||
+        header->byte_order != HASHWAL_BYTE_ORDER)
+        return 0;
+
+    while (size - offset >= sizeof(hashwal_record_t)) {
+        record = (const hashwal_record_t *) (map + offset);
+
+        // Lengths are checked before they are used to read the bytes
+        if (record->key_length > size ||
+            (record->value_length != HASHWAL_NULL_VALUE &&
+             record->value_length > size))
+            break;
+        bytes = hashtable_wal_record_bytes(record->key_length,
+                                           record->value_length);
+        if (bytes > size - offset ||
+            (record->type != HASHWAL_SET && record->type != HASHWAL_DELETE) ||
+            record->checksum != hashtable_wal_checksum(record))
+            break;
+
+        data = (char *) (record + 1);
+        if (hashtable_wal_add_item(items, count, items_size, record->type,
+                                   data,
+                                   record->value_length != HASHWAL_NULL_VALUE
+                                   ? data + (record->key_length + 7) / 8 * 8
+                                   : NULL) != 0)
+            return (size_t) -1;
+
+        offset += bytes;
+    }
+
+    return offset;
+}
+
+/*
+ * Replays the changes of one thread (see hashwal_replay_s).
+ */
+static void *hashtable_wal_replay_worker(void *arg) {
+
+    hashwal_worker_t *worker = (hashwal_worker_t *) arg;
+    hashwal_replay_t *replay = worker->replay;
+    hashwal_item_t *item = NULL;
+    hashtable_t *table = replay->tables[worker->id];
+    unsigned long start, end, i;
+
+    if (replay->phase == 0) {
+        start = replay->count * worker->id / replay->threads;
+        end = replay->count * (worker->id + 1) / replay->threads;
+        for (i = start; i < end; i++)
+            replay->items[i].hash = hashtable_hash_key(replay->tables[0],
+                                                       replay->items[i].key);
+        return NULL;
+    }
+
+    for (i = 0; i < replay->count && worker->result == 0; i++) {
+        item = &replay->items[i];
+        if (item->hash % replay->threads != worker->id)
+            continue;
+        if (item->type == HASHWAL_SET)
+            worker->result = hashtable_wal_apply_set(replay->wal, table,
+                                                     item->key, item->value,
+                                                     item->hash);
+        else
+            worker->result = hashtable_delete_key_hashed(table, item->key,
+                                                         item->hash);
+    }
+
+    return NULL;
+}
+
+/*
+ * Runs "count" replay workers, the calling thread being one of them. If a
+ * thread cannot be created its work is done by the calling thread.
+ */
+static void hashtable_wal_run_workers(hashwal_worker_t *workers,
+                                      unsigned int count) {
+
+    pthread_t threads[HASHTABLE_WAL_MAX_THREADS];
+    int started[HASHTABLE_WAL_MAX_THREADS];
+    unsigned int i;
+
+    for (i = 1; i < count; i++)
+        started[i] = pthread_create(&threads[i], NULL,
+                                    hashtable_wal_replay_worker,
+                                    &workers[i]) == 0;
+
+    hashtable_wal_replay_worker(&workers[0]);
+
+    for (i = 1; i < count; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            hashtable_wal_replay_worker(&workers[i]);
+    }
+}
+
+/*
+ * Replays changes into "tables": with several threads every one of them
+ * fills its own table, and the tables are merged into the last one.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_replay(hashtable_wal_t *wal, hashwal_item_t *items,
+                                unsigned long count, hashtable_t **tables,
+                                unsigned int threads) {
+
+    hashwal_worker_t workers[HASHTABLE_WAL_MAX_THREADS];
+    hashwal_replay_t replay;
+    unsigned int i;
+
+    replay.wal = wal;
+    replay.items = items;
+    replay.count = count;
+    replay.tables = tables;
+    replay.threads = threads;
+
+    for (i = 0; i < threads; i++) {
+        workers[i].replay = &replay;
+        workers[i].id = i;
+        workers[i].result = 0;
+    }
+
+    for (replay.phase = 0; replay.phase < 2; replay.phase++)
+        hashtable_wal_run_workers(workers, threads);
+
+    for (i = 0; i < threads; i++)
+        if (workers[i].result != 0)
+            return -1;
+
+    // Keys of different threads never meet, so no values are combined
+    if (threads > 1)
+        return hashtable_merge_shards(tables[threads], tables, threads, NULL);
+
+    return 0;
+}
+
+/*
+ * Replays the snapshot and the log of a table into "tables" (see
+ * hashtable_wal_replay()), and opens the log to append records to it.
+ * Return: 0 on success, -1 on error.
+ */
+static int hashtable_wal_load(hashtable_wal_t *wal, hashtable_t **tables,
+                              unsigned int threads,
+                              fp_compare_keys compare_function,
+                              fp_hashvalue hashvalue_function,
+                              const hashtable_options_t *options) {
+
+    hashtable_t *snapshot = NULL;
+    hashtable_iterator_t iterator;
+    hashwal_item_t *items = NULL;
+    hashwal_header_t header;
+    unsigned long count = 0;
+    unsigned long size = 0;
+    void *key = NULL;
+    void *value = NULL;
+    char *map = NULL;
+    struct stat st;
+    size_t valid = 0;
+    int result = -1;
+
+    // The snapshot is replayed first, as changes that set its keys
+    if (access(wal->snapshot_path, F_OK) == 0) {
+        snapshot = hashtable_open_mapped(wal->snapshot_path,
+                                         compare_function,
+                                         hashvalue_function, options);
+        if (snapshot == NULL)
+            return -1;
+
+        hashtable_iterator_init(snapshot, &iterator);
+        while (result == -1 && hashtable_iterator_next(&iterator, &key,
+                                                       &value))
+            if (hashtable_wal_add_item(&items, &count, &size, HASHWAL_SET,
+                                       key, value) != 0)
+                result = -2;
+        hashtable_iterator_release(&iterator);
+        if (result == -2) {
+            result = -1;
+            goto end;
+        }
+    }
+
+    wal->fd = open(wal->path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (wal->fd < 0 || fstat(wal->fd, &st) != 0)
+        goto end;
+
+    // A crash while the header was written leaves a file without records
+    if (st.st_size > 0 && (size_t) st.st_size < sizeof(hashwal_header_t)) {
+        if (ftruncate(wal->fd, 0) != 0)
+            goto end;
+        st.st_size = 0;
+    }
+
+    if (st.st_size > 0) {
+        map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                            wal->fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            goto end;
+        }
+        valid = hashtable_wal_read_log(map, st.st_size, &items, &count,
+                                       &size);
+        if (valid == 0 || valid == (size_t) -1)
+            goto end;
+    }
+
+    if (hashtable_wal_replay(wal, items, count, tables, threads) != 0)
+        goto end;
+
+    // A partial record at the end is dropped before appending new ones
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, HASHWAL_MAGIC, sizeof(header.magic));
+        header.byte_order = HASHWAL_BYTE_ORDER;
+        if (hashtable_wal_write(wal->fd, (char *) &header,
+                                sizeof(header)) != 0 ||
+            fdatasync(wal->fd) != 0 || hashtable_wal_sync_directory(wal) != 0)
+            goto end;
+        valid = sizeof(header);
+    }
+    else if (valid < (size_t) st.st_size &&
+             (ftruncate(wal->fd, valid) != 0 || fdatasync(wal->fd) != 0))
+        goto end;
+
+    wal->log_bytes = valid;
+    result = 0;
+
+end:
+    if (map != NULL)
+        munmap(map, st.st_size);
+    hashtable_delete(snapshot);
+    free(items);
+    return result;
+}
+
+
+/**** WAL HASHTABLE FUNCTIONS *************************************************/
+
+/*
+ * Fills "options" with the default values.
+ */
+void hashtable_wal_options_init(hashtable_wal_options_t *options) {
+
+    if (options == NULL)
+        return;
+
+    options->sync = HASHTABLE_WAL_SYNC_COMMIT;
+    options->sync_interval = HASHTABLE_WAL_DEFAULT_SYNC_INTERVAL;
+    options->batch_bytes = HASHTABLE_WAL_DEFAULT_BATCH_BYTES;
+    options->compact_bytes = HASHTABLE_WAL_DEFAULT_COMPACT_BYTES;
+}
+
+/*
+ * Frees a log that may be partially opened.
+ */
+static void hashtable_wal_free(hashtable_wal_t *wal) {
+
+    if (wal->fd >= 0)
+        close(wal->fd);
+    hashtable_delete(wal->table);
+    pthread_rwlock_destroy(&wal->table_lock);
+    pthread_mutex_destroy(&wal->compact_lock);
+    pthread_mutex_destroy(&wal->lock);
+    pthread_cond_destroy(&wal->committed);
+    free(wal->buffer);
+    free(wal->spare);
+    free(wal->path);
+    free(wal->snapshot_path);
+    free(wal);
+}
+
+/*
+ * Opens a table with a write-ahead log, replaying its snapshot and log.
+ * Return: NULL if error, pointer to the table on success.
+ */
+hashtable_wal_t *hashtable_wal_open(const char *path, unsigned long size,
+                              fp_compare_keys compare_function,
+                              fp_hashvalue hashvalue_function,
+                              const hashtable_options_t *options,
+                              const hashtable_wal_options_t *wal_options) {
+
+    hashtable_wal_t *wal = NULL;
+    hashtable_options_t table_options;
+    hashtable_t **tables = NULL;
+    hashtable_t *table = NULL;
+    unsigned int threads;
+
+    if (path == NULL)
+        return NULL;
+
+    if (options != NULL)
+        table_options = *options;
+    else
+        hashtable_options_init(&table_options);
+
+    if (table_options.max_entries > 0 || table_options.max_bytes > 0)
+        return NULL;
+
+    // Keys of other types need their own compare function
+    if (compare_function == NULL) {
+        if (table_options.key_length != NULL)
+            return NULL;
+        compare_function = hashtable_wal_string_compare;
+    }
+
+    // The table owns copies of keys and values, freed when replaced
+    table_options.intern_keys = 0;
+    table_options.intern_values = 0;
+
+    threads = table_options.threads > 0 ? table_options.threads : 1;
+    if (threads > HASHTABLE_WAL_MAX_THREADS)
+        threads = HASHTABLE_WAL_MAX_THREADS;
+
+    wal = (hashtable_wal_t *) calloc (1, sizeof(hashtable_wal_t));
+    if (wal == NULL)
+        return NULL;
+
+    wal->fd = -1;
+    pthread_rwlock_init(&wal->table_lock, NULL);
+    pthread_mutex_init(&wal->compact_lock, NULL);
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->committed, NULL);
+
+    if (wal_options != NULL)
+        wal->options = *wal_options;
+    else
+        hashtable_wal_options_init(&wal->options);
+
+    wal->key_length = table_options.key_length != NULL
+                      ? table_options.key_length
+                      : hashtable_wal_string_length;
+    wal->value_length = table_options.value_length != NULL
+                        ? table_options.value_length
+                        : hashtable_wal_string_length;
+    wal->last_sync = hashtable_wal_now();
+
+    wal->path = strdup(path);
+    wal->snapshot_path = (char *) malloc (strlen(path) + 10);
+    if (wal->path == NULL || wal->snapshot_path == NULL)
+        goto error;
+    sprintf(wal->snapshot_path, "%s.snapshot", path);
+
+    table = hashtable_create_with_options(size, compare_function,
+                                          hashvalue_function, free, free,
+                                          &table_options);
+    if (table == NULL)
+        goto error;
+    wal->table = table;
+
+    // Every thread replays into its own table, with the seed of the final
+    // one so merged keys are not hashed again
+    if (threads > 1) {
+        table_options.seed = hashtable_seed(table);
+        table_options.threads = 1;
+        tables = hashtable_create_shards(threads + 1, size / threads + 1,
+                                         compare_function, hashvalue_function,
+                                         free, free, &table_options);
+        if (tables == NULL)
+            goto error;
+        hashtable_delete(tables[threads]);
+        tables[threads] = table;
+    }
+    else {
+        tables = (hashtable_t **) malloc (sizeof(hashtable_t *));
+        if (tables == NULL)
+            goto error;
+        tables[0] = table;
+    }
+
+    if (hashtable_wal_load(wal, tables, threads, compare_function,
+                           hashvalue_function, options) != 0)
+        goto error;
+
+    if (threads > 1)
+        hashtable_delete_shards(tables, threads);
+    else
+        free(tables);
+
+    return wal;
+
+error:
+    if (tables != NULL && threads > 1)
+        hashtable_delete_shards(tables, threads);
+    else
+        free(tables);
+    hashtable_wal_free(wal);
+    return NULL;
+}
+
+/*
+ * Introduces or replaces a key-value pair, appending the change to the log.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_set(hashtable_wal_t *wal, void *key, void *value) {
+
+    unsigned long hash;
+    int result = -1;
+    int full = 0;
+
+    if (wal == NULL || key == NULL)
+        return -1;
+
+    hash = hashtable_hash_key(wal->table, key);
+
+    pthread_rwlock_wrlock(&wal->table_lock);
+    pthread_mutex_lock(&wal->lock);
+
+    // Appended first: if the table fails the record is removed
+    if (!wal->failed &&
+        hashtable_wal_append(wal, HASHWAL_SET, key, value) == 0) {
+        result = hashtable_wal_apply_set(wal, wal->table, key, value, hash);
+        if (result != 0)
+            hashtable_wal_unappend(wal, key, value);
+        full = wal->buffer_used >= wal->options.batch_bytes;
+    }
+
+    pthread_mutex_unlock(&wal->lock);
+    pthread_rwlock_unlock(&wal->table_lock);
+
+    if (result == 0 && full)
+        result = hashtable_wal_commit(wal);
+
+    return result;
+}
+
+/*
+ * Removes a key-value pair, appending the change to the log.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_delete_key(hashtable_wal_t *wal, void *key) {
+
+    unsigned long hash;
+    unsigned long count;
+    int result = -1;
+    int full = 0;
+
+    if (wal == NULL || key == NULL)
+        return -1;
+
+    hash = hashtable_hash_key(wal->table, key);
+
+    pthread_rwlock_wrlock(&wal->table_lock);
+    pthread_mutex_lock(&wal->lock);
+
+    // Appended first, and removed if the key was not in the table or the
+    // table fails, so deleting missing keys does not grow the log
+    count = hashtable_count(wal->table);
+    if (!wal->failed &&
+        hashtable_wal_append(wal, HASHWAL_DELETE, key, NULL) == 0) {
+        result = hashtable_delete_key_hashed(wal->table, key, hash);
+        if (result != 0 || hashtable_count(wal->table) == count)
+            hashtable_wal_unappend(wal, key, NULL);
+        full = wal->buffer_used >= wal->options.batch_bytes;
+    }
+
+    pthread_mutex_unlock(&wal->lock);
+    pthread_rwlock_unlock(&wal->table_lock);
+
+    if (result == 0 && full)
+        result = hashtable_wal_commit(wal);
+
+    return result;
+}
+
+/*
+ * Return: NULL if not found or on error, value on success.
+ */
+void *hashtable_wal_get(hashtable_wal_t *wal, void *key) {
+
+    unsigned long hash;
+    void *value;
+
+    if (wal == NULL || key == NULL)
+        return NULL;
+
+    hash = hashtable_hash_key(wal->table, key);
+
+    pthread_rwlock_rdlock(&wal->table_lock);
+    value = hashtable_peek_hashed(wal->table, key, hash);
+    pthread_rwlock_unlock(&wal->table_lock);
+
+    return value;
+}
+
+/*
+ * Writes the buffered changes to the log, compacting it if it is too large.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_commit(hashtable_wal_t *wal) {
+
+    int compact;
+
+    if (wal == NULL || hashtable_wal_flush(wal, 0) != 0)
+        return -1;
+
+    pthread_mutex_lock(&wal->lock);
+    compact = wal->options.compact_bytes > 0 &&
+              wal->log_bytes >= wal->options.compact_bytes;
+    pthread_mutex_unlock(&wal->lock);
+
+    return compact ? hashtable_wal_compact(wal) : 0;
+}
+
+/*
+ * Saves the table to its snapshot and empties the log.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_compact(hashtable_wal_t *wal) {
+
+    int result = -1;
+
+    if (wal == NULL)
+        return -1;
+
+    // No changes until the log is emptied, the snapshot has all of them.
+    // hashtable_save() does not change the table, so lookups go on.
+    // hashtable_save() syncs the directory, so the log is never emptied
+    // while the old snapshot could come back after a crash
+    pthread_mutex_lock(&wal->compact_lock);
+    pthread_rwlock_rdlock(&wal->table_lock);
+
+    if (hashtable_wal_flush(wal, 0) == 0 &&
+        hashtable_save(wal->table, wal->snapshot_path, wal->key_length,
+                       wal->value_length) == 0) {
+        pthread_mutex_lock(&wal->lock);
+        if (ftruncate(wal->fd, sizeof(hashwal_header_t)) == 0 &&
+            fdatasync(wal->fd) == 0) {
+            wal->log_bytes = sizeof(hashwal_header_t);
+            result = 0;
+        }
+        else
+            wal->failed = 1;
+        pthread_mutex_unlock(&wal->lock);
+    }
+
+    pthread_rwlock_unlock(&wal->table_lock);
+    pthread_mutex_unlock(&wal->compact_lock);
+
+    return result;
+}
+
+/*
+ * Return: Table of the log.
+ */
+hashtable_t *hashtable_wal_table(hashtable_wal_t *wal) {
+
+    return wal != NULL ? wal->table : NULL;
+}
+
+/*
+ * Commits the buffered changes, syncs the log and frees the table.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_close(hashtable_wal_t *wal) {
+
+    int result;
+
+    if (wal == NULL)
+        return -1;
+
+    result = hashtable_wal_flush(wal, 1);
+    hashtable_wal_free(wal);
+
+    return result;
+}
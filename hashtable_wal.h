@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * Hash Table with a Write-Ahead Log.
+ *
+ * A hash table kept in memory whose changes are appended to a log file, so
+ * it survives a crash. Changes are buffered and written in batches (group
+ * commit): every batch is one sequential write, and one fsync with the
+ * default policy, shared by all the threads that commit at the same time.
+ * When the table is opened again the log is replayed on top of the last
+ * snapshot, and the log is compacted into a new snapshot when it grows.
+ *
+ * Keys and values are stored as bytes, like in hashtable_save(): the table
+ * keeps its own copies of them (freed when they are replaced or deleted), so
+ * they cannot contain pointers.
+ *
+ * License: MIT
+ * Github: github.com/adrian-bueno/hashtable
+ ******************************************************************************/
+
+#ifndef _HASHTABLE_WAL_H_
+#define _HASHTABLE_WAL_H_
+
+#include "hashtable.h"
+
+/*
+ * Hash table with a write-ahead log type.
+ */
+typedef struct hashtable_wal_s hashtable_wal_t;
+
+/*
+ * When the log is synced to the disk (fdatasync).
+ *
+ * HASHTABLE_WAL_SYNC_COMMIT: every commit, changes committed survive a crash
+ * of the system.
+ * HASHTABLE_WAL_SYNC_INTERVAL: at most once every "sync_interval"
+ * milliseconds, on a commit. Committed changes survive a crash of the
+ * process, and the changes of the last interval may be lost with a crash of
+ * the system.
+ * HASHTABLE_WAL_SYNC_NEVER: only when the log is closed or compacted.
+ */
+typedef enum hashtable_wal_sync_e {
+    HASHTABLE_WAL_SYNC_COMMIT,
+    HASHTABLE_WAL_SYNC_INTERVAL,
+    HASHTABLE_WAL_SYNC_NEVER
+} hashtable_wal_sync_t;
+
+/*
+ * Options of the log. Initialize them with hashtable_wal_options_init() and
+ * change only the fields you need.
+ *
+ * "sync": see hashtable_wal_sync_t. Default: HASHTABLE_WAL_SYNC_COMMIT.
+ * "sync_interval": milliseconds between syncs with
+ * HASHTABLE_WAL_SYNC_INTERVAL. Default: 1000.
+ * "batch_bytes": changes are buffered until there are this many bytes, then
+ * they are committed by the call that fills the buffer. Larger batches mean
+ * fewer writes and syncs. Default: 64 KB.
+ * "compact_bytes": when a commit leaves the log larger than this many bytes
+ * the table is compacted (see hashtable_wal_compact()). 0 never compacts
+ * automatically. Default: 64 MB.
+ */
+typedef struct hashtable_wal_options_s {
+    hashtable_wal_sync_t sync;
+    unsigned long sync_interval;
+    size_t batch_bytes;
+    size_t compact_bytes;
+} hashtable_wal_options_t;
+
+/*
+ * Fills "options" with the default values.
+ */
+void hashtable_wal_options_init(hashtable_wal_options_t *options);
+
+/*
+ * Opens the table logged at "path", creating an empty one if the file does
+ * not exist. The snapshot of the table is "path.snapshot". The snapshot and
+ * then the log are replayed into a new table; a partial change at the end of
+ * the log (a crash in the middle of a write) is dropped. With the "threads"
+ * option every thread replays the keys of its part of the hash values into
+ * its own table, and the tables are merged in parallel, every thread moving
+ * a range of buckets.
+ * Parameters "size", "compare_function", "hashvalue_function" and "options"
+ * are used to create the table, as in hashtable_create_with_options(). The
+ * "key_length" and "value_length" options give the bytes of keys and values
+ * (NULL for C strings), the "intern_keys" and "intern_values" options are not
+ * used and the table cannot be a cache. "compare_function" can be NULL for C
+ * string keys.
+ * Parameter "wal_options" can be NULL to use the default options.
+ * Return: NULL if error, pointer to the table on success.
+ */
+hashtable_wal_t *hashtable_wal_open(const char *path, unsigned long size,
+                              fp_compare_keys compare_function,
+                              fp_hashvalue hashvalue_function,
+                              const hashtable_options_t *options,
+                              const hashtable_wal_options_t *wal_options);
+
+/*
+ * Same as hashtable_set(), appending the change to the log. Key and value
+ * are copied, they still belong to the caller. The change is durable when
+ * hashtable_wal_commit() returns, or when a later change fills the batch.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_set(hashtable_wal_t *wal, void *key, void *value);
+
+/*
+ * Same as hashtable_delete_key(), appending the change to the log if the key
+ * was in the table.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_delete_key(hashtable_wal_t *wal, void *key);
+
+/*
+ * Same as hashtable_get(). Only waits for threads modifying the table. The
+ * value belongs to the table and is freed when the key is replaced or
+ * deleted, so if other threads can do it while the value is used, the
+ * caller must coordinate with them.
+ * Return: NULL if not found or on error, value on success.
+ */
+void *hashtable_wal_get(hashtable_wal_t *wal, void *key);
+
+/*
+ * Writes the changes buffered so far to the log and syncs it (see
+ * hashtable_wal_sync_t). If another thread is already writing, the call
+ * waits for it and the changes of all waiting threads are written together
+ * by one of them.
+ * Return: 0 on success, -1 on error. After a failed write every later call
+ * fails: reopen the table to recover.
+ */
+int hashtable_wal_commit(hashtable_wal_t *wal);
+
+/*
+ * Saves the table to "path.snapshot" with hashtable_save() and empties the
+ * log. Changes wait until it ends, hashtable_wal_get() does not. A crash in
+ * the middle leaves either the old snapshot and the whole log, or the new
+ * snapshot and a log that gives the same table when replayed on top of it.
+ * Return: 0 on success, -1 on error.
+ */
+int hashtable_wal_compact(hashtable_wal_t *wal);
+
+/*
+ * Return: Table of the log, to iterate over it or read its statistics. It
+ * cannot be used while other threads use the log, and changes made directly
+ * to it are not logged.
+ */
+hashtable_t *hashtable_wal_table(hashtable_wal_t *wal);
+
+/*
+ * Commits the changes buffered, syncs the log and frees all memory of the
+ * table. No other thread can be using it.
+ * Return: 0 on success, -1 if the last changes could not be written.
+ */
+int hashtable_wal_close(hashtable_wal_t *wal);
+
+#endif